@@ -0,0 +1,259 @@
+"""
+Gateway emulator and load generator: plays the root mote of one or more DODAGs behind the serial socket of
+Cooja, so that serv.py can be benchmarked without motes.
+
+Each emulated gateway listens on its own port, speaks the serial protocol of the root (serial_protocol.py),
+and synthesizes the records of its motes:
+- the DAOs of its light sensors, lightbulbs and sprinklers (REC_PATH), refreshed every DAO_PERIOD,
+- the readings of the sensors (REC_LIGHT), every period with some jitter, with extra bursts if asked.
+  The light level alternates between light and dark phases of the same length,
+- for each command of the server, the ACKs of the actuators after an emulated delay and the report of the
+  command (REC_PATH ACK and REC_CMD), or a REC_ELIDED when all the actuators are still on, like the root.
+
+It measures the readings the server accepted per second (the socket only takes what the server reads),
+the reaction latency (start of a dark phase to the lightbulb command), the commands received, and the memory
+of the server if its pid is given.
+
+Example: 3 gateways of 500 sensors reporting every 5 s, against serv.py --gateway localhost:60001 ... :60003
+	python3 gateway_emulator.py --gateways 3 --sensors 500 --period 5
+"""
+
+import argparse
+import asyncio
+import random
+import struct
+import time
+
+from serial_protocol import (Decoder, encodeFrame, REC_LIGHT, REC_PATH, REC_CMD, REC_ELIDED, REC_COMMAND)
+
+# Types of the motes
+LIGHT_SENSOR = 2
+SPRINKLER = 3
+LIGHTBULB = 4
+
+# Time the actuators stay on after a command [sec] (routing.h), and before the end of which they are commanded again
+ON_DURATION = {SPRINKLER: 180, LIGHTBULB: 120}
+ACTUATOR_RENEW = 20
+
+# Period of the DAOs of the motes [sec]
+DAO_PERIOD = 60
+# Light level of the light and dark phases, and noise of the readings
+LIGHT_LEVEL = 600
+DARK_LEVEL = 300
+LEVEL_NOISE = 50
+# Records per frame, as the uplink buffer of the root packs them
+RECORDS_PER_FRAME = 7
+# Resolution of the generation of the readings [sec]
+TICK = 0.01
+
+
+class Stats:
+	"""
+	Measures of all the emulated gateways.
+	"""
+	def __init__(self):
+		self.readings = 0
+		self.lastReadings = 0
+		self.commands = {}
+		self.elided = 0
+		self.reactions = []
+
+	def percentile(self, p):
+		ordered = sorted(self.reactions)
+		return ordered[min(len(ordered) - 1, int(p / 100 * len(ordered)))] if ordered else 0
+
+
+class Gateway:
+	"""
+	Emulated root with its motes, serving one connection of the server at a time on its port.
+	"""
+	def __init__(self, port, args, stats):
+		self.port = port
+		self.args = args
+		self.stats = stats
+		# Addresses of the motes: the sensors first, then the lightbulbs and the sprinklers
+		self.sensors = list(range(2, 2 + args.sensors))
+		self.actuators = {LIGHTBULB: list(range(2 + args.sensors, 2 + args.sensors + args.lightbulbs))}
+		first = 2 + args.sensors + args.lightbulbs
+		self.actuators[SPRINKLER] = list(range(first, first + args.sprinklers))
+		self.onUntil = {}	# actuator -> time until which it is on
+		self.darkSince = None	# start of the dark phase waiting for its lightbulb command
+		self.lastCommand = 0
+		self.hops = {src: random.randint(1, 4) for src in self.sensors + self.actuators[LIGHTBULB] + self.actuators[SPRINKLER]}
+
+	def level(self, now):
+		"""
+		Returns the light level at the given time, and starts the measure of the reaction at each dark phase.
+		"""
+		dark = int((now - self.start) / self.args.phase) % 2 == 1
+		if dark and self.darkSince is None:
+			self.darkSince = now
+		elif not dark:
+			self.darkSince = None
+		return (DARK_LEVEL if dark else LIGHT_LEVEL) + random.randint(-LEVEL_NOISE, LEVEL_NOISE)
+
+	def light(self, src, now):
+		return (REC_LIGHT, struct.pack("<HHBH", src, self.level(now), self.hops[src], random.randint(5, 200)))
+
+	def daos(self):
+		records = [(REC_PATH, struct.pack("<BHBBH", 0, src, LIGHT_SENSOR, self.hops[src], 10)) for src in self.sensors]
+		for typeMote, addresses in self.actuators.items():
+			records += [(REC_PATH, struct.pack("<BHBBH", 0, src, typeMote, self.hops[src], 10)) for src in addresses]
+		return records
+
+	async def write(self, writer, records):
+		"""
+		Writes the records in frames, waiting until the server has read them.
+		"""
+		for i in range(0, len(records), RECORDS_PER_FRAME):
+			writer.write(encodeFrame(records[i:i + RECORDS_PER_FRAME]))
+		await writer.drain()
+
+	async def serve(self, reader, writer):
+		print(f"Gateway {self.port}: server connected")
+		self.start = time.monotonic()
+		tasks = [asyncio.create_task(self.readings(writer)), asyncio.create_task(self.refresh(writer))]
+		decoder = Decoder()
+		try:
+			while True:
+				data = await reader.read(4096)
+				if not data:
+					break
+				for item in decoder.feed(data):
+					if item[0] == "record" and item[1] == REC_COMMAND and item[2]:
+						asyncio.create_task(self.command(item[2][0], writer))
+		except OSError:
+			pass
+		finally:
+			for task in tasks:
+				task.cancel()
+			writer.close()
+		print(f"Gateway {self.port}: server disconnected")
+
+	async def refresh(self, writer):
+		"""
+		Sends the DAOs of all the motes every DAO_PERIOD.
+		"""
+		while True:
+			await self.write(writer, self.daos())
+			await asyncio.sleep(DAO_PERIOD)
+
+	async def readings(self, writer):
+		"""
+		Sends the readings of the sensors: each one every period, at a random phase, and the bursts.
+		"""
+		period, nextBurst = self.args.period, self.start + self.args.burst_period
+		due = [(self.start + random.uniform(0, period), src) for src in self.sensors]
+		due.sort()
+		while True:
+			now = time.monotonic()
+			records = []
+			while due and due[0][0] <= now:
+				_, src = due.pop(0)
+				records.append(self.light(src, now))
+				due.append((now + period * random.uniform(0.9, 1.1), src))
+			if self.args.burst_period and now >= nextBurst:
+				records += [self.light(random.choice(self.sensors), now) for _ in range(self.args.burst_size)]
+				nextBurst += self.args.burst_period
+			if records:
+				due.sort()
+				await self.write(writer, records)
+				self.stats.readings += len(records)
+			await asyncio.sleep(TICK)
+
+	async def command(self, typeMote, writer):
+		"""
+		Emulates the root for a command of the server: the actuators off or about to go off are turned on,
+		and acknowledge it after a delay, or the command is elided if all of them are on.
+		"""
+		now = time.monotonic()
+		self.stats.commands[typeMote] = self.stats.commands.get(typeMote, 0) + 1
+		if typeMote == LIGHTBULB and self.darkSince is not None:
+			self.stats.reactions.append(now - self.darkSince)
+			self.darkSince = None
+		addresses = self.actuators.get(typeMote, [])
+		targets = [src for src in addresses if self.onUntil.get(src, 0) <= now + ACTUATOR_RENEW]
+		if not targets:
+			self.stats.elided += 1
+			await self.write(writer, [(REC_ELIDED, struct.pack("<BB", typeMote, len(addresses)))])
+			return
+		self.lastCommand = (self.lastCommand + 1) % 256
+		cmdId = self.lastCommand
+		records, latency = [], 0
+		for src in targets:
+			delay = random.uniform(0.05, self.args.ack_delay)
+			latency = max(latency, delay)
+			self.onUntil[src] = now + ON_DURATION[typeMote]
+			records.append((REC_PATH, struct.pack("<BHBBH", 1, src, typeMote, self.hops[src], int(delay * 100))))
+		await asyncio.sleep(latency)
+		records.append((REC_CMD, struct.pack("<BBBBI", cmdId, typeMote, len(targets), len(targets), int(latency * 1000))))
+		await self.write(writer, records)
+
+
+def serverMemory(pid):
+	"""
+	Returns the resident memory of the process [kB], or None if it can't be read.
+	"""
+	try:
+		with open(f"/proc/{pid}/status") as status:
+			for line in status:
+				if line.startswith("VmRSS:"):
+					return int(line.split()[1])
+	except OSError:
+		return None
+
+
+async def report(stats, args):
+	"""
+	Prints the measures every report period.
+	"""
+	start = last = time.monotonic()
+	while True:
+		await asyncio.sleep(args.report)
+		now = time.monotonic()
+		rate = (stats.readings - stats.lastReadings) / (now - last)
+		target = args.gateways * (args.sensors / args.period + (args.burst_size / args.burst_period if args.burst_period else 0))
+		stats.lastReadings, last = stats.readings, now
+		memory = serverMemory(args.pid) if args.pid else None
+		print(f"[{now - start:.0f} s] readings {rate:.0f}/s (target {target:.0f}/s, {stats.readings} in total), "
+			f"commands {stats.commands}, elided {stats.elided}, "
+			f"reaction p50 {stats.percentile(50):.2f} s p99 {stats.percentile(99):.2f} s"
+			+ (f", server memory {memory} kB" if memory is not None else ""))
+
+
+async def main(args):
+	stats = Stats()
+	servers = []
+	for i in range(args.gateways):
+		gateway = Gateway(args.port + i, args, stats)
+		servers.append(await asyncio.start_server(gateway.serve, args.ip, args.port + i))
+	print(f"Emulating {args.gateways} gateways on ports {args.port}-{args.port + args.gateways - 1}")
+	reporter = asyncio.create_task(report(stats, args))
+	try:
+		if args.duration:
+			await asyncio.sleep(args.duration)
+		else:
+			await asyncio.Event().wait()
+	finally:
+		reporter.cancel()
+		for server in servers:
+			server.close()
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description="Emulates gateways to benchmark serv.py")
+	parser.add_argument("--ip", default="localhost")
+	parser.add_argument("--port", type=int, default=60001, help="port of the first gateway")
+	parser.add_argument("--gateways", type=int, default=1)
+	parser.add_argument("--sensors", type=int, default=100, help="light sensors per gateway")
+	parser.add_argument("--lightbulbs", type=int, default=10, help="lightbulbs per gateway")
+	parser.add_argument("--sprinklers", type=int, default=10, help="sprinklers per gateway")
+	parser.add_argument("--period", type=float, default=60, help="reporting period of each sensor [sec]")
+	parser.add_argument("--phase", type=float, default=300, help="length of the light and dark phases [sec]")
+	parser.add_argument("--burst-period", type=float, default=0, help="period of the bursts of readings [sec], 0 for none")
+	parser.add_argument("--burst-size", type=int, default=0, help="readings of a burst")
+	parser.add_argument("--ack-delay", type=float, default=2, help="largest delay of the ACKs of a command [sec]")
+	parser.add_argument("--duration", type=float, default=0, help="time to run [sec], 0 to run until interrupted")
+	parser.add_argument("--report", type=float, default=10, help="period of the measures [sec]")
+	parser.add_argument("--pid", type=int, help="pid of serv.py, to measure its memory")
+	asyncio.run(main(parser.parse_args()))
@@ -0,0 +1,151 @@
+"""
+Metrics of the server, exposed over HTTP in the text format of Prometheus (version 0.0.4).
+
+The metrics are counters, gauges and histograms, each with its own label names. The server updates
+them as it processes the records, and the values that are states rather than events (connection of the
+gateways, queues) are refreshed by the collectors just before each scrape.
+	curl http://localhost:9108/metrics
+"""
+
+import asyncio
+
+# Buckets of the latency histograms: powers of two [ms]
+LATENCY_BUCKETS = [2 ** i for i in range(16)]
+
+# Bytes of a request read at most
+REQUEST_MAX = 8192
+
+
+def escape(value):
+	return str(value).replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n")
+
+
+def formatLabels(names, values, extra=""):
+	labels = ",".join(f"{name}=\"{escape(value)}\"" for name, value in zip(names, values))
+	if extra:
+		labels = f"{labels},{extra}" if labels else extra
+	return f"{{{labels}}}" if labels else ""
+
+
+def bucketLabel(bound):
+	return "le=\"" + formatValue(bound) + "\""
+
+
+def formatValue(value):
+	if value == float("inf"):
+		return "+Inf"
+	return repr(float(value)) if isinstance(value, float) else str(value)
+
+
+class Metric:
+	"""
+	Metric of a kind (counter, gauge or histogram), with a value per combination of the values of its labels.
+	"""
+	def __init__(self, name, kind, help, labels=(), buckets=None):
+		self.name = name
+		self.kind = kind
+		self.help = help
+		self.labels = tuple(labels)
+		self.buckets = buckets
+		self.values = {}	# label values -> value, or [bucket counts, sum, count] for a histogram
+
+	def inc(self, *labels, amount=1):
+		self.values[labels] = self.values.get(labels, 0) + amount
+
+	def set(self, *labels, value):
+		self.values[labels] = value
+
+	def observe(self, *labels, value):
+		"""
+		Adds a sample to the histogram, in the first bucket it fits in.
+		"""
+		histogram = self.values.get(labels)
+		if histogram is None:
+			histogram = self.values[labels] = [[0] * len(self.buckets), 0, 0]
+		for i, bound in enumerate(self.buckets):
+			if value <= bound:
+				histogram[0][i] += 1
+				break
+		histogram[1] += value
+		histogram[2] += 1
+
+	def render(self):
+		lines = [f"# HELP {self.name} {self.help}", f"# TYPE {self.name} {self.kind}"]
+		for labels, value in sorted(self.values.items()):
+			if self.kind != "histogram":
+				lines.append(f"{self.name}{formatLabels(self.labels, labels)} {formatValue(value)}")
+				continue
+			counts, total, count = value
+			cumulative = 0
+			for bound, n in zip(self.buckets, counts):
+				cumulative += n
+				lines.append(f"{self.name}_bucket{formatLabels(self.labels, labels, bucketLabel(bound))} {cumulative}")
+			lines.append(f"{self.name}_bucket{formatLabels(self.labels, labels, bucketLabel(float('inf')))} {count}")
+			lines.append(f"{self.name}_sum{formatLabels(self.labels, labels)} {formatValue(total)}")
+			lines.append(f"{self.name}_count{formatLabels(self.labels, labels)} {count}")
+		return lines
+
+
+class Registry:
+	"""
+	Metrics of the server, and the collectors called before each scrape.
+	"""
+	def __init__(self):
+		self.metrics = []
+		self.collectors = []
+
+	def add(self, metric):
+		self.metrics.append(metric)
+		return metric
+
+	def counter(self, name, help, labels=()):
+		return self.add(Metric(name, "counter", help, labels))
+
+	def gauge(self, name, help, labels=()):
+		return self.add(Metric(name, "gauge", help, labels))
+
+	def histogram(self, name, help, labels=(), buckets=LATENCY_BUCKETS):
+		return self.add(Metric(name, "histogram", help, labels, buckets))
+
+	def collector(self, function):
+		self.collectors.append(function)
+
+	def render(self):
+		"""
+		Returns the text exposition of all the metrics.
+		"""
+		for function in self.collectors:
+			function()
+		lines = []
+		for metric in self.metrics:
+			lines += metric.render()
+		return "\n".join(lines) + "\n"
+
+
+async def serve(registry, host, port):
+	"""
+	Function used to serve the metrics of the registry on GET /metrics until cancelled.
+	"""
+	async def handle(reader, writer):
+		try:
+			request = await reader.readuntil(b"\r\n\r\n")
+		except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, OSError):
+			writer.close()
+			return
+		method, _, rest = request.decode(errors="replace").partition(" ")
+		path = rest.split(" ", 1)[0].split("?", 1)[0]
+		if method == "GET" and path == "/metrics":
+			status, body = "200 OK", registry.render().encode()
+		else:
+			status, body = "404 Not Found", b"Not found: the metrics are at /metrics\n"
+		writer.write(f"HTTP/1.1 {status}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			f"Content-Length: {len(body)}\r\nConnection: close\r\n\r\n".encode() + body)
+		try:
+			await writer.drain()
+		except OSError:
+			pass
+		writer.close()
+
+	server = await asyncio.start_server(handle, host, port, limit=REQUEST_MAX)
+	async with server:
+		await server.serve_forever()
@@ -0,0 +1,137 @@
+/**
+ * Aggregation of the ACK messages by the sub gateways.
+ */
+
+#include "ack-aggregation.h"
+#include "rx-queue.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Represents the ACKs of a command received during the current window
+typedef struct ack_slot {
+	uint8_t in_use;
+	ACKAGG_message_t aggregate;
+	ACK_message_t first;	// sent as is if it is the only ACK of the window
+	clock_time_t first_received;	// time the first ACK was received, its residence includes the window
+	struct ctimer timer;
+} ack_slot_t;
+
+static ack_slot_t slots[ACK_AGG_SLOTS];
+
+// Mote that aggregates, used by the callback to reach the parent
+static mote_t *aggregating_mote;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Callback function, called at the end of the window of a command.
+ * Sends the aggregate to the parent, or the original ACK if there was only one.
+ */
+static void flush_callback(void *ptr) {
+	ack_slot_t *slot = (ack_slot_t*) ptr;
+	slot->in_use = 0;
+
+	if (!aggregating_mote->in_dodag) {
+		return;
+	}
+	if (slot->aggregate.count == 1 && slot->first.type == ACK) {
+		forward_ACK(&(slot->first), slot->first_received, aggregating_mote);
+	} else {
+		LOG_INFO("ACKAGG cmd %u: %u acks merged\n", slot->aggregate.cmd_id, slot->aggregate.count);
+		forward_ACKAGG(&(slot->aggregate), aggregating_mote);
+	}
+}
+
+/**
+ * Returns the slot of the given command, starting a new window if there is none.
+ * Returns NULL if all the slots are used by other commands.
+ */
+static ack_slot_t* get_slot(uint8_t cmd_id, uint8_t typeMote, mote_t *mote) {
+	int i;
+	ack_slot_t *free_slot = NULL;
+	for (i = 0; i < ACK_AGG_SLOTS; i++) {
+		if (slots[i].in_use && slots[i].aggregate.cmd_id == cmd_id) {
+			return &slots[i];
+		}
+		if (!slots[i].in_use && free_slot == NULL) {
+			free_slot = &slots[i];
+		}
+	}
+	if (free_slot != NULL) {
+		aggregating_mote = mote;
+		free_slot->in_use = 1;
+		memset(&(free_slot->aggregate), 0, ACKAGG_size);
+		free_slot->aggregate.type = ACKAGG;
+		free_slot->aggregate.typeMote = typeMote;
+		free_slot->aggregate.cmd_id = cmd_id;
+		free_slot->first.type = 0;
+		ctimer_set(&(free_slot->timer), ACK_AGG_WINDOW, flush_callback, free_slot);
+	}
+	return free_slot;
+}
+
+/**
+ * Keeps the given trace in the aggregate if it is slower than the one already there.
+ */
+static void keep_slowest_trace(ack_slot_t *slot, const linkaddr_t *src, trace_t *trace) {
+	if (trace->hops > 0 && (slot->aggregate.trace.hops == 0
+		|| trace_delay(trace) > trace_delay(&(slot->aggregate.trace)))) {
+		linkaddr_copy(&(slot->aggregate.trace_src), src);
+		memcpy(&(slot->aggregate.trace), trace, sizeof(trace_t));
+	}
+}
+
+/**
+ * Adds a received ACK message to the aggregate of its command.
+ * If no aggregate can be started, the ACK is forwarded right away.
+ */
+void aggregate_ACK(ACK_message_t *message, mote_t *mote) {
+	ack_slot_t *slot = get_slot(message->cmd_id, message->typeMote, mote);
+	if (slot == NULL) {
+		forward_ACK(message, rx_received(), mote);
+		return;
+	}
+	if (slot->aggregate.count == 0) {
+		memcpy(&(slot->first), message, ACK_size);
+		slot->first_received = rx_received();
+	}
+	keep_slowest_trace(slot, &(message->src_addr), &(message->trace));
+	ack_bitmap_set(slot->aggregate.bitmap, &(message->src_addr));
+	if (slot->aggregate.count < 255) {
+		slot->aggregate.count++;
+	}
+}
+
+/**
+ * Merges a received ACKAGG message into the aggregate of its command.
+ * If no aggregate can be started, the ACKAGG is forwarded right away.
+ */
+void aggregate_ACKAGG(ACKAGG_message_t *message, mote_t *mote) {
+	ack_slot_t *slot = get_slot(message->cmd_id, message->typeMote, mote);
+	if (slot == NULL) {
+		forward_ACKAGG(message, mote);
+		return;
+	}
+	int i;
+	for (i = 0; i < ACK_BITMAP_BYTES; i++) {
+		slot->aggregate.bitmap[i] |= message->bitmap[i];
+	}
+	slot->first.type = 0; // the aggregate must be sent even if it holds a single ACK
+	keep_slowest_trace(slot, &(message->trace_src), &(message->trace));
+	if (slot->aggregate.count + message->count > 255) {
+		slot->aggregate.count = 255;
+	} else {
+		slot->aggregate.count += message->count;
+	}
+}
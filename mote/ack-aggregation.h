@@ -0,0 +1,43 @@
+/**
+ * Aggregation of the ACK messages by the sub gateways.
+ *
+ * The ACKs of the same command received during a short window are merged into a single
+ * ACKAGG message, carrying the number of ACKs and a bitmap of the motes that sent them.
+ * The aggregate keeps the trace of the slowest actuator.
+ */
+
+#ifndef ACK_AGGREGATION_H_
+#define ACK_AGGREGATION_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Number of commands that can be aggregated at the same time
+#define ACK_AGG_SLOTS 2
+
+// Time during which the ACKs of a command are merged, starting at the first one [clock ticks]
+#define ACK_AGG_WINDOW CLOCK_SECOND
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Adds a received ACK message to the aggregate of its command.
+ * If no aggregate can be started, the ACK is forwarded right away.
+ */
+void aggregate_ACK(ACK_message_t *message, mote_t *mote);
+
+/**
+ * Merges a received ACKAGG message into the aggregate of its command.
+ * If no aggregate can be started, the ACKAGG is forwarded right away.
+ */
+void aggregate_ACKAGG(ACKAGG_message_t *message, mote_t *mote);
+
+#endif /* ACK_AGGREGATION_H_ */
@@ -0,0 +1,277 @@
+/**
+ * Tracking of the TURNON commands by the root.
+ */
+
+#include "commands.h"
+#include "serial-protocol.h"
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Represents a command waiting for its ACKs
+typedef struct command {
+	uint8_t in_use;
+	uint8_t cmd_id;
+	uint8_t typeMote;
+	clock_time_t sent;
+	clock_time_t last_ack;
+	uint8_t expected[ACK_BITMAP_BYTES];	// actuators known when the command was sent
+	uint8_t acked[ACK_BITMAP_BYTES];
+	struct ctimer timer;
+} command_t;
+
+static command_t commands[COMMAND_SLOTS];
+
+// Time until which each actuator of the ACK bitmaps is on [sec], 0 if unknown
+static unsigned long on_until[ACK_BITMAP_BITS];
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Reports a command to the server in a REC_CMD record, and stops tracking it.
+ * The latency is the time until the last ACK, or 0 if no ACK was received.
+ */
+static void command_report(command_t *command) {
+	unsigned i;
+	unsigned expected = 0;
+	unsigned acked = 0;
+	for (i = 0; i < ACK_BITMAP_BITS; i++) {
+		expected += ack_bitmap_test(command->expected, i);
+		acked += ack_bitmap_test(command->acked, i) && ack_bitmap_test(command->expected, i);
+	}
+	unsigned long latency = 0;
+	if (command->last_ack != 0) {
+		latency = (unsigned long) (command->last_ack - command->sent) * 1000 / CLOCK_SECOND;
+	}
+	serial_begin(REC_CMD);
+	serial_u8(command->cmd_id);
+	serial_u8(command->typeMote);
+	serial_u8(acked);
+	serial_u8(expected);
+	serial_u32(latency);
+	for (i = 0; i < ACK_BITMAP_BITS; i++) {
+		if (ack_bitmap_test(command->expected, i) && !ack_bitmap_test(command->acked, i)) {
+			serial_u8(i);
+		}
+	}
+	serial_end();
+
+	ctimer_stop(&(command->timer));
+	command->in_use = 0;
+}
+
+/**
+ * Reports the trace of a command to the server in a REC_TRACE record.
+ * The round trip time goes from the sending of the command to the reception of the ACK.
+ */
+static void trace_report(command_t *command, const linkaddr_t *src, trace_t *trace) {
+	unsigned long rtt = (unsigned long) (clock_time() - command->sent) * 1000 / CLOCK_SECOND;
+	serial_begin(REC_TRACE);
+	serial_u8(command->cmd_id);
+	serial_u16(src->u16[0]);
+	serial_u32(rtt);
+	serial_u8(trace->hops);
+	unsigned i;
+	for (i = 0; i < trace->hops && i < TRACE_MAX_HOPS; i++) {
+		serial_u8(trace->hop[i].node);
+		serial_u16(trace->hop[i].delay * TRACE_DELAY_UNIT);
+	}
+	serial_end();
+}
+
+/**
+ * Callback function, called when a command times out.
+ */
+static void timeout_callback(void *ptr) {
+	command_report((command_t*) ptr);
+}
+
+/**
+ * Returns the command with the given ID, or NULL if it isn't tracked.
+ */
+static command_t* command_lookup(uint8_t cmd_id) {
+	int i;
+	for (i = 0; i < COMMAND_SLOTS; i++) {
+		if (commands[i].in_use && commands[i].cmd_id == cmd_id) {
+			return &commands[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns the time an actuator of the given typeMote stays on after a command [sec], or 0 if
+ * its state isn't tracked.
+ */
+static uint16_t on_duration(uint8_t typeMote) {
+	switch (typeMote) {
+	case 3:
+		return TIMEOUT_WATER;
+	case 4:
+		return TIMEOUT_LIGHT;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Records the actuators that acknowledged a command: they are on at least until the
+ * on-duration after the command left the root.
+ */
+static void actuators_on(command_t *command) {
+	unsigned i;
+	uint16_t duration = on_duration(command->typeMote);
+	if (duration == 0) {
+		return;
+	}
+	unsigned long until = clock_seconds() - (clock_time() - command->sent) / CLOCK_SECOND + duration;
+	for (i = 0; i < ACK_BITMAP_BITS; i++) {
+		if (ack_bitmap_test(command->acked, i)) {
+			on_until[i] = until;
+		}
+	}
+}
+
+/**
+ * Reports the command if all the expected actuators acknowledged it.
+ */
+static void command_check(command_t *command) {
+	int i;
+	command->last_ack = clock_time();
+	actuators_on(command);
+	for (i = 0; i < ACK_BITMAP_BYTES; i++) {
+		if (command->expected[i] & ~(command->acked[i])) {
+			return;
+		}
+	}
+	command_report(command);
+}
+
+/**
+ * Fills the targets bitmap with the actuators of the given typeMote of the routing table of the
+ * mote that are off or about to go off. Returns 0 if the command must not be sent: some actuators
+ * are known and all of them are still on, and the command is reported to the server as elided.
+ * A command for which no actuator is known is sent, with no target: the routing table may be empty
+ * or stale, and an MPL flood reaches the actuators anyway.
+ */
+uint8_t command_targets(uint8_t typeMote, uint8_t *targets, mote_t *mote) {
+	int i;
+	unsigned bit;
+	uint8_t count = 0;
+	uint8_t on = 0;
+	unsigned long now = clock_seconds();
+
+	memset(targets, 0, ACK_BITMAP_BYTES);
+	hashmap_element* map = mote->routing_table->data;
+	for (i = 0; i < mote->routing_table->table_size; i++) {
+		hashmap_element elem = *(map+i);
+		if (!elem.in_use || elem.typeMote != typeMote) {
+			continue;
+		}
+		bit = elem.key % ACK_BITMAP_BITS;
+		if (ack_bitmap_test(targets, bit)) {
+			continue;
+		}
+		if (on_until[bit] > now + ACTUATOR_RENEW) {
+			on++;
+		} else {
+			targets[bit/8] |= 1 << (bit%8);
+			count++;
+		}
+	}
+
+	if (count == 0 && on > 0) {
+		serial_begin(REC_ELIDED);
+		serial_u8(typeMote);
+		serial_u8(on);
+		serial_end();
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Starts tracking a command sent to the given typeMote.
+ * The actuators expected to acknowledge it are the ones of the targets bitmap.
+ */
+void command_sent(uint8_t cmd_id, uint8_t typeMote, const uint8_t *targets) {
+	command_t *command = NULL;
+	int i;
+	for (i = 0; i < COMMAND_SLOTS && command == NULL; i++) {
+		if (!commands[i].in_use) {
+			command = &commands[i];
+		}
+	}
+	if (command == NULL) {
+		// Report the oldest command early to make room
+		command = &commands[0];
+		for (i = 1; i < COMMAND_SLOTS; i++) {
+			if (commands[i].sent < command->sent) {
+				command = &commands[i];
+			}
+		}
+		command_report(command);
+	}
+
+	command->in_use = 1;
+	command->cmd_id = cmd_id;
+	command->typeMote = typeMote;
+	command->sent = clock_time();
+	command->last_ack = 0;
+	memcpy(command->expected, targets, ACK_BITMAP_BYTES);
+	memset(command->acked, 0, ACK_BITMAP_BYTES);
+
+	if (!memcmp(command->expected, command->acked, ACK_BITMAP_BYTES)) {
+		// No actuator of this type is known, nothing to wait for
+		command_report(command);
+		return;
+	}
+	ctimer_set(&(command->timer), CLOCK_SECOND*COMMAND_TIMEOUT, timeout_callback, command);
+}
+
+/**
+ * Records the ACK of a single actuator.
+ */
+void command_ACK(ACK_message_t *message) {
+	command_t *command = command_lookup(message->cmd_id);
+	if (command == NULL) {
+		serial_begin(REC_LATE_ACK);
+		serial_u8(message->cmd_id);
+		serial_u16(message->src_addr.u16[0]);
+		serial_end();
+		return;
+	}
+	if (message->trace.hops > 0) {
+		trace_report(command, &(message->src_addr), &(message->trace));
+	}
+	ack_bitmap_set(command->acked, &(message->src_addr));
+	command_check(command);
+}
+
+/**
+ * Records the ACKs merged in an ACKAGG message.
+ */
+void command_ACKAGG(ACKAGG_message_t *message) {
+	command_t *command = command_lookup(message->cmd_id);
+	if (command == NULL) {
+		serial_begin(REC_LATE_ACKAGG);
+		serial_u8(message->cmd_id);
+		serial_u8(message->count);
+		serial_end();
+		return;
+	}
+	if (message->trace.hops > 0) {
+		trace_report(command, &(message->trace_src), &(message->trace));
+	}
+	int i;
+	for (i = 0; i < ACK_BITMAP_BYTES; i++) {
+		command->acked[i] |= message->bitmap[i];
+	}
+	command_check(command);
+}
@@ -0,0 +1,65 @@
+/**
+ * Tracking of the TURNON commands by the root.
+ *
+ * The root remembers the actuators it expects an ACK from for each command, merges the
+ * ACK and ACKAGG messages it receives, and reports to the server when all the actuators
+ * acknowledged the command or when the command times out.
+ * The traces returned with the ACKs are reported as they arrive.
+ *
+ * The ACKs also tell the root until when each actuator stays on: it turns on for TIMEOUT_LIGHT
+ * or TIMEOUT_WATER after the command, which left the root before. A command from the server
+ * only targets the actuators that are off or about to go off, and is not sent at all when
+ * they are all on.
+ */
+
+#ifndef COMMANDS_H_
+#define COMMANDS_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Number of commands tracked at the same time
+#define COMMAND_SLOTS 4
+
+// Time after which a command is reported with its missing actuators [sec]
+#define COMMAND_TIMEOUT 10
+
+// Time before the end of the on-duration of an actuator from which it is commanded again [sec]
+#define ACTUATOR_RENEW 20
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Fills the targets bitmap with the actuators of the given typeMote of the routing table of the
+ * mote that are off or about to go off. Returns 0 if the command must not be sent: some actuators
+ * are known and all of them are still on, and the command is reported to the server as elided.
+ * A command for which no actuator is known is sent, with no target: the routing table may be empty
+ * or stale, and an MPL flood reaches the actuators anyway.
+ */
+uint8_t command_targets(uint8_t typeMote, uint8_t *targets, mote_t *mote);
+
+/**
+ * Starts tracking a command sent to the given typeMote.
+ * The actuators expected to acknowledge it are the ones of the targets bitmap.
+ */
+void command_sent(uint8_t cmd_id, uint8_t typeMote, const uint8_t *targets);
+
+/**
+ * Records the ACK of a single actuator.
+ */
+void command_ACK(ACK_message_t *message);
+
+/**
+ * Records the ACKs merged in an ACKAGG message.
+ */
+void command_ACKAGG(ACKAGG_message_t *message);
+
+#endif /* COMMANDS_H_ */
@@ -0,0 +1,137 @@
+/**
+ * TSCH schedule of the motes, derived from the DODAG like the Orchestra schedules.
+ */
+
+#include "dodag-schedule.h"
+#include "net/mac/tsch/tsch.h"
+#include "net/packetbuf.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+///////////////////
+///  VARIABLES  ///
+///////////////////
+
+// Slotframes of the schedule
+static struct tsch_slotframe *sf_unicast;
+static struct tsch_slotframe *sf_common;
+
+// Timeslot of the receive cell of this mote in the unicast slotframe
+static uint16_t rx_slot;
+
+// 1 for the timeslots of the unicast slotframe with a transmit cell
+static uint8_t tx_slots[SCHEDULE_UNICAST_PERIOD];
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Returns the timeslot of the receive cell of a mote in the unicast slotframe.
+ */
+static uint16_t slot_of(const linkaddr_t *addr) {
+	return addr->u16[0] % SCHEDULE_UNICAST_PERIOD;
+}
+
+/**
+ * Installs the cell of a timeslot of the unicast slotframe, or removes it if it is unused.
+ * The cell is addressed to broadcast: the packet selection is done by schedule_packet_ready.
+ */
+static void set_cell(uint16_t slot) {
+	uint8_t options = 0;
+	if (slot == rx_slot) {
+		options |= LINK_OPTION_RX;
+	}
+	if (tx_slots[slot]) {
+		options |= LINK_OPTION_TX | LINK_OPTION_SHARED;
+	}
+
+	if (options == 0) {
+		tsch_schedule_remove_link_by_offsets(sf_unicast, slot, SCHEDULE_UNICAST_OFFSET);
+	} else {
+		tsch_schedule_add_link(sf_unicast, options, LINK_TYPE_NORMAL, &tsch_broadcast_address,
+			slot, SCHEDULE_UNICAST_OFFSET, 1);
+	}
+}
+
+/**
+ * Installs the slotframes, with the receive cell of the mote.
+ * The root (rank 0) starts the TSCH network as coordinator, the others scan for EBs.
+ */
+void schedule_init(const mote_t *mote) {
+	sf_unicast = tsch_schedule_add_slotframe(SCHEDULE_UNICAST_HANDLE, SCHEDULE_UNICAST_PERIOD);
+	sf_common = tsch_schedule_add_slotframe(SCHEDULE_COMMON_HANDLE, SCHEDULE_COMMON_PERIOD);
+
+	// Shared cell for the EBs and the broadcasts
+	tsch_schedule_add_link(sf_common, LINK_OPTION_RX | LINK_OPTION_TX | LINK_OPTION_SHARED,
+		LINK_TYPE_ADVERTISING, &tsch_broadcast_address, 0, SCHEDULE_COMMON_OFFSET, 1);
+
+	rx_slot = slot_of(&linkaddr_node_addr);
+	set_cell(rx_slot);
+
+	if (mote->rank == 0) {
+		tsch_set_coordinator(1);
+	}
+}
+
+/**
+ * Recomputes the transmit cells from the parent and the routing table of the mote,
+ * and makes the parent the time source. Called when the parent or the children change.
+ */
+void schedule_update(const mote_t *mote) {
+	uint8_t slots[SCHEDULE_UNICAST_PERIOD] = {0};
+	uint16_t i;
+
+	if (mote->in_dodag && mote->rank != 0) {
+		slots[slot_of(&(mote->parent->addr))] = 1;
+		tsch_queue_update_time_source(&(mote->parent->addr));
+	}
+
+	// The next hops of the routing table are the children
+	if (mote->routing_table != NULL) {
+		hashmap_element* map = mote->routing_table->data;
+		for (i = 0; i < mote->routing_table->table_size; i++) {
+			if (map[i].in_use) {
+				slots[slot_of(&map[i].data)] = 1;
+			}
+		}
+	}
+
+	for (i = 0; i < SCHEDULE_UNICAST_PERIOD; i++) {
+		if (slots[i] != tx_slots[i]) {
+			tx_slots[i] = slots[i];
+			set_cell(i);
+		}
+	}
+}
+
+/**
+ * TSCH_CALLBACK_PACKET_READY: puts the packet in the packet buffer in the cell of its receiver.
+ */
+int schedule_packet_ready(void) {
+	const linkaddr_t *dest = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+	uint16_t slotframe = SCHEDULE_COMMON_HANDLE;
+	uint16_t slot = 0;
+
+	// Unicast to a neighbour of the DODAG, in its receive cell
+	if (!linkaddr_cmp(dest, &linkaddr_null) && tx_slots[slot_of(dest)]) {
+		slotframe = SCHEDULE_UNICAST_HANDLE;
+		slot = slot_of(dest);
+	}
+
+	packetbuf_set_attr(PACKETBUF_ATTR_TSCH_SLOTFRAME, slotframe);
+	packetbuf_set_attr(PACKETBUF_ATTR_TSCH_TIMESLOT, slot);
+	return 1;
+}
+
+/**
+ * Returns 1 if the mote is synchronized with the TSCH network and can send.
+ */
+uint8_t schedule_associated() {
+	return tsch_is_associated;
+}
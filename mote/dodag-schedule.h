@@ -0,0 +1,79 @@
+/**
+ * TSCH schedule of the motes, derived from the DODAG like the Orchestra schedules.
+ *
+ * Two slotframes are installed on every mote:
+ * - the common slotframe has a single shared cell, for the EBs and the broadcasts (DIS, DIO,
+ *   broadcast TURNON, MPL). It replaces the 6TiSCH minimal schedule;
+ * - the unicast slotframe is receiver-based: each mote listens in the timeslot given by the
+ *   hash of its own address, and transmits to a neighbour in the timeslot of the neighbour.
+ *   The transmit cells are those of the parent and of the next hops of the routing table
+ *   (the children), and are recomputed when the DODAG changes.
+ * A unicast to a mote without a transmit cell (before the DODAG converges) leaves in the
+ * common cell. The parent is the time source of the mote.
+ */
+
+#ifndef DODAG_SCHEDULE_H_
+#define DODAG_SCHEDULE_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Lengths of the slotframes [timeslots], prime to spread the cells of the two slotframes
+#ifndef SCHEDULE_COMMON_PERIOD
+#define SCHEDULE_COMMON_PERIOD 31
+#endif
+#ifndef SCHEDULE_UNICAST_PERIOD
+#define SCHEDULE_UNICAST_PERIOD 17
+#endif
+
+// Handles of the slotframes: a unicast cell has priority over the common cell in the same timeslot
+#define SCHEDULE_UNICAST_HANDLE 0
+#define SCHEDULE_COMMON_HANDLE  1
+
+// Channel offsets of the cells
+#define SCHEDULE_UNICAST_OFFSET 1
+#define SCHEDULE_COMMON_OFFSET  0
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+#if MOTE_TSCH
+
+/**
+ * Installs the slotframes, with the receive cell of the mote.
+ * The root (rank 0) starts the TSCH network as coordinator, the others scan for EBs.
+ */
+void schedule_init(const mote_t *mote);
+
+/**
+ * Recomputes the transmit cells from the parent and the routing table of the mote,
+ * and makes the parent the time source. Called when the parent or the children change.
+ */
+void schedule_update(const mote_t *mote);
+
+/**
+ * TSCH_CALLBACK_PACKET_READY: puts the packet in the packet buffer in the cell of its receiver.
+ */
+int schedule_packet_ready(void);
+
+/**
+ * Returns 1 if the mote is synchronized with the TSCH network and can send.
+ */
+uint8_t schedule_associated();
+
+#else
+
+#define schedule_init(mote)
+#define schedule_update(mote)
+#define schedule_associated() 1
+
+#endif
+
+#endif /* DODAG_SCHEDULE_H_ */
@@ -0,0 +1,174 @@
+/**
+ * Energy accounting of the motes, based on energest.
+ */
+
+#include "energy.h"
+#include "sys/energest.h"
+#include "serial-protocol.h"
+
+
+///////////////////
+///  VARIABLES  ///
+///////////////////
+
+// Energest times at the start of the period
+static uint64_t start_cpu;
+static uint64_t start_lpm;
+static uint64_t start_listen;
+static uint64_t start_transmit;
+static clock_time_t start_time;
+
+// Radio time of each message class over the period [energest ticks]
+static uint32_t tx_ticks[ENERGY_CLASSES];
+static uint32_t rx_ticks[ENERGY_CLASSES];
+
+// LIGHT messages sent over the period
+static uint8_t readings;
+
+// Class and energest transmit time of the frame handed to the MAC
+static uint8_t tx_class;
+static uint64_t tx_start;
+static uint8_t tx_pending = 0;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Returns 1 if the address is the one of this mote.
+ */
+static uint8_t is_own(const linkaddr_t *addr) {
+	return linkaddr_cmp(addr, &linkaddr_node_addr);
+}
+
+/**
+ * Returns the class of a frame. The upward messages of other motes are relayed.
+ */
+static uint8_t classify(const uint8_t *frame) {
+	switch (frame[0]) {
+	case MSG_DIS:
+	case MSG_DIO:
+		return ENERGY_CLASS_DIO;
+	case MSG_DAO:
+		return is_own(&(((DAO_message_t*) frame)->src_addr)) ? ENERGY_CLASS_DAO : ENERGY_CLASS_FORWARD;
+	case MSG_LIGHT:
+		return is_own(&(((LIGHT_message_t*) frame)->src_addr)) ? ENERGY_CLASS_LIGHT : ENERGY_CLASS_FORWARD;
+	case MSG_ACK:
+		return is_own(&(((ACK_message_t*) frame)->src_addr)) ? ENERGY_CLASS_COMMAND : ENERGY_CLASS_FORWARD;
+	case MSG_ENERGY:
+		return is_own(&(((ENERGY_message_t*) frame)->src_addr)) ? ENERGY_CLASS_REPORT : ENERGY_CLASS_FORWARD;
+	default:
+		return ENERGY_CLASS_COMMAND;
+	}
+}
+
+/**
+ * Converts a duration in energest ticks to the given unit [ms], saturating at 65535.
+ */
+static uint16_t to_unit(uint64_t ticks, unsigned unit) {
+	uint64_t value = ticks * 1000 / ENERGEST_SECOND / unit;
+	return value > 65535 ? 65535 : value;
+}
+
+/**
+ * Starts the first period of the accounting.
+ */
+void energy_init() {
+	ENERGY_message_t message;
+	energy_report(&message);
+}
+
+/**
+ * Called by the transmit queue when a frame is handed to the MAC.
+ */
+void energy_tx_start(const uint8_t *frame, uint16_t len) {
+	tx_class = classify(frame);
+	if (tx_class == ENERGY_CLASS_LIGHT && readings < 255) {
+		readings++;
+	}
+	energest_flush();
+	tx_start = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+	tx_pending = 1;
+}
+
+/**
+ * Called by the transmit queue when the MAC is done with the frame: its transmit time
+ * is added to its class.
+ */
+void energy_tx_done() {
+	if (tx_pending) {
+		energest_flush();
+		tx_ticks[tx_class] += energest_type_time(ENERGEST_TYPE_TRANSMIT) - tx_start;
+		tx_pending = 0;
+	}
+}
+
+/**
+ * Called by the receive queue for each frame received: its estimated receive time
+ * is added to its class.
+ */
+void energy_rx(const uint8_t *frame, uint16_t len) {
+	rx_ticks[classify(frame)] += (uint32_t) (len + ENERGY_FRAME_OVERHEAD) * ENERGEST_SECOND / ENERGY_BYTE_RATE;
+}
+
+/**
+ * Fills an ENERGY message with the energy spent since the last report, and starts a new period.
+ */
+void energy_report(ENERGY_message_t *message) {
+	uint8_t i;
+	energest_flush();
+	uint64_t cpu = energest_type_time(ENERGEST_TYPE_CPU);
+	uint64_t lpm = energest_type_time(ENERGEST_TYPE_LPM) + energest_type_time(ENERGEST_TYPE_DEEP_LPM);
+	uint64_t listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+	uint64_t transmit = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+
+	message->type = ENERGY;
+	linkaddr_copy(&(message->src_addr), &linkaddr_node_addr);
+	message->period = (clock_time() - start_time) / CLOCK_SECOND;
+	message->cpu = to_unit(cpu - start_cpu, ENERGY_UNIT);
+	message->lpm = to_unit(lpm - start_lpm, ENERGY_UNIT);
+	message->listen = to_unit(listen - start_listen, ENERGY_UNIT);
+	message->transmit = to_unit(transmit - start_transmit, ENERGY_UNIT);
+	for (i = 0; i < ENERGY_CLASSES; i++) {
+		message->tx[i] = to_unit(tx_ticks[i], 1);
+		message->rx[i] = to_unit(rx_ticks[i], 1);
+		tx_ticks[i] = 0;
+		rx_ticks[i] = 0;
+	}
+	message->readings = readings;
+
+	start_cpu = cpu;
+	start_lpm = lpm;
+	start_listen = listen;
+	start_transmit = transmit;
+	start_time = clock_time();
+	readings = 0;
+}
+
+#if MOTE_ROOT
+/**
+ * Sends an energy report to the server, in a REC_ENERGY record.
+ */
+void energy_upload(const ENERGY_message_t *message) {
+	uint8_t i;
+	serial_begin(REC_ENERGY);
+	serial_u16(message->src_addr.u16[0]);
+	serial_u16(message->period);
+	serial_u32((uint32_t) message->cpu * ENERGY_UNIT);
+	serial_u32((uint32_t) message->lpm * ENERGY_UNIT);
+	serial_u32((uint32_t) message->listen * ENERGY_UNIT);
+	serial_u32((uint32_t) message->transmit * ENERGY_UNIT);
+	for (i = 0; i < ENERGY_CLASSES; i++) {
+		serial_u16(message->tx[i]);
+	}
+	for (i = 0; i < ENERGY_CLASSES; i++) {
+		serial_u16(message->rx[i]);
+	}
+	serial_u8(message->readings);
+	serial_u16(message->drops);
+	serial_u8(message->routes);
+	serial_end();
+}
+#endif
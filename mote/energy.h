@@ -0,0 +1,93 @@
+/**
+ * Energy accounting of the motes, based on energest.
+ *
+ * The time spent by the MCU (active and low-power) and by the radio (listening and transmitting)
+ * is sampled every ENERGY_PERIOD seconds, and reported to the root in an ENERGY message.
+ * The radio time is also split by message class: the transmit time of a frame is measured
+ * by energest between the moment it is handed to the MAC and the end of its transmission
+ * (retransmissions included), the receive time is estimated from the length of the frame.
+ * The root sends the reports to the server.
+ */
+
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Message classes of the radio time
+#define ENERGY_CLASS_DIO     0	// DIS, DIO
+#define ENERGY_CLASS_DAO     1	// DAO of the mote
+#define ENERGY_CLASS_LIGHT   2	// LIGHT of the mote
+#define ENERGY_CLASS_FORWARD 3	// DAO, LIGHT, ACK and ENERGY of other motes, relayed upward
+#define ENERGY_CLASS_COMMAND 4	// TURNON, MPL, ACK and ACKAGG of the mote, MAINT, MAINTACK
+#define ENERGY_CLASS_REPORT  5	// ENERGY of the mote
+
+// Period of the energy reports [sec]
+#ifndef ENERGY_PERIOD
+#define ENERGY_PERIOD 300
+#endif
+
+// Unit of the time spent in each state in the reports [ms]
+#define ENERGY_UNIT 10
+
+// Bytes sent on the air around the payload of a frame: PHY header, MAC header and FCS
+#define ENERGY_FRAME_OVERHEAD 17
+
+// Bit rate of the radio [bytes/sec]
+#define ENERGY_BYTE_RATE 31250
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+#if ENERGY_REPORTS
+
+/**
+ * Starts the first period of the accounting.
+ */
+void energy_init();
+
+/**
+ * Called by the transmit queue when a frame is handed to the MAC.
+ */
+void energy_tx_start(const uint8_t *frame, uint16_t len);
+
+/**
+ * Called by the transmit queue when the MAC is done with the frame: its transmit time
+ * is added to its class.
+ */
+void energy_tx_done();
+
+/**
+ * Called by the receive queue for each frame received: its estimated receive time
+ * is added to its class.
+ */
+void energy_rx(const uint8_t *frame, uint16_t len);
+
+/**
+ * Fills an ENERGY message with the energy spent since the last report, and starts a new period.
+ */
+void energy_report(ENERGY_message_t *message);
+
+/**
+ * Sends an energy report to the server, in a REC_ENERGY record (see serial-protocol.h).
+ */
+void energy_upload(const ENERGY_message_t *message);
+
+#else
+
+#define energy_init()
+#define energy_tx_start(frame, len)
+#define energy_tx_done()
+#define energy_rx(frame, len)
+
+#endif
+
+#endif /* ENERGY_H_ */
@@ -88,7 +88,7 @@ int hashmap_fill_rehash(hashmap_map *m, hashmap_element *old_array, int old_tabl
 		if (old_array[i].in_use == 0)
 		    continue;
 	    	uint8_t isRehashing = 1;
-		int status = hashmap_put_int(m, old_array[i].key, old_array[i].data, old_array[i].typeMote, old_array[i].time, isRehashing);
+		int status = hashmap_put_int(m, old_array[i].key, old_array[i].data, old_array[i].typeMote, old_array[i].rss, old_array[i].time, isRehashing);
 		if (status == MAP_FULL) {
 			// have to rehash for more memory !
 			return status;
@@ -178,7 +178,7 @@ hashmap_map * hashmap_new() {
  *		  while already called by rehash, MAP_NEW if an element was added,
  * 		  MAP_UPDATE if an element was updated.
  */
-int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t typeMote, unsigned long time, uint8_t isRehashing) {
+int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t typeMote, signed char rss, unsigned long time, uint8_t isRehashing) {
 	if (DEBUG_MODE) printf("Trying to put node %u. Rehashing : %d\n", key, isRehashing);
 	if (!isRehashing && DEBUG_MODE) {
 		hashmap_print(m);
@@ -209,6 +209,7 @@ int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t type
 	}
 	m->data[index].data = value;
 	m->data[index].typeMote = typeMote;
+	m->data[index].rss = rss;
 	m->data[index].time = time;
 	m->data[index].key = key;
 	if (DEBUG_MODE) printf("Node with key %u added\n",key);
@@ -223,10 +224,10 @@ int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t type
  * Return value : MAP_OMEM if out of memory, MAP_NEW if an element was added,
  * 		  MAP_UPDATE if an element was updated.
  */
-int hashmap_put(hashmap_map *m, linkaddr_t key, uint8_t typeMote, linkaddr_t value) {
+int hashmap_put(hashmap_map *m, linkaddr_t key, uint8_t typeMote, linkaddr_t value, signed char rss) {
 	unsigned long time = clock_seconds();
 	uint8_t isRehashing = 0;
-	return hashmap_put_int(m, linkaddr2uint16_t(key), value, typeMote, time, isRehashing);
+	return hashmap_put_int(m, linkaddr2uint16_t(key), value, typeMote, rss, time, isRehashing);
 }
 
 /**
@@ -12,6 +12,9 @@
  * and removed thread synchronization - http://petewarden.typepad.com
  */
 
+#ifndef HASHMAP_H_
+#define HASHMAP_H_
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -50,12 +53,14 @@
  * the key should be the node from which we received a message
  * the data should be the next-hop to get to the key node
  * the typeMote should be the type of the key node
+ * the rss should be the signal strength of the link to the next-hop
  */
 typedef struct _hashmap_element{
 	uint16_t key;
 	uint8_t in_use;
 	linkaddr_t data;
 	uint8_t typeMote;
+	signed char rss;
 	unsigned long time;
 } hashmap_element;
 
@@ -127,7 +132,7 @@ extern hashmap_map *hashmap_new();
  *		  while already called by rehash, MAP_NEW if an element was added,
  * 		  MAP_UPDATE if an element was updated.
  */
-extern int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t typeMote, unsigned long time, uint8_t isRehashing);
+extern int hashmap_put_int(hashmap_map *m, uint16_t key, linkaddr_t value, uint8_t typeMote, signed char rss, unsigned long time, uint8_t isRehashing);
 
 /**
  * $arg will point to the element with the given key
@@ -144,7 +149,7 @@ extern int hashmap_remove_int(hashmap_map *m, uint16_t key);
  * The following functions are calling the upper ones with slightly modified arguments
  * These function are easier to call
  */
-extern int hashmap_put(hashmap_map *m, linkaddr_t key, uint8_t typeMote, linkaddr_t value);
+extern int hashmap_put(hashmap_map *m, linkaddr_t key, uint8_t typeMote, linkaddr_t value, signed char rss);
 extern int hashmap_get(hashmap_map *m, linkaddr_t key, uint8_t* typeMote, linkaddr_t *arg);
 extern int hashmap_remove(hashmap_map *m, linkaddr_t key);
 
@@ -169,3 +174,5 @@ extern void hashmap_print(hashmap_map *m);
  * Returns 1 if at least one element has been removed, 0 if no element has been removed.
  */
 extern int hashmap_delete_timeout(hashmap_map *m);
+
+#endif /* HASHMAP_H_ */
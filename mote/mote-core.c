@@ -0,0 +1,552 @@
+/**
+ * Core shared by all the motes.
+ */
+
+#include "mote-core.h"
+#include "rx-queue.h"
+#include "tx-queue.h"
+#include "mpl.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+// Represents the attributes of this mote
+mote_t mote;
+
+// Trickle timer for the periodic messages
+trickle_timer_t t_timer;
+
+
+
+/////////////////////////
+///  CALLBACK TIMERS  ///
+/////////////////////////
+
+// Callback timer to send information messages
+static sched_timer_t send_timer;
+
+#if MOTE_NODE
+// Callback timer to send DAO messages to parent
+static sched_timer_t DAO_timer;
+
+// Callback timer to detach from lost parent
+static sched_timer_t parent_timer;
+#endif
+
+#if MOTE_ROUTER
+// Callback timer to delete unresponsive children
+static sched_timer_t children_timer;
+
+// Number of sweeps of the children timer in a row without any child
+static uint8_t childless_sweeps = 0;
+#endif
+
+// Timer of the report of the wakeups
+static sched_timer_t report_timer;
+
+/**
+ * Callback function that logs the wakeups of the scheduler, scaled to one hour.
+ */
+static void report_callback(void *ptr) {
+	uint16_t expirations;
+	uint16_t wakeups = sched_wakeups(&expirations);
+	LOG_INFO("Wakeups %lu per hour, for %lu timer expirations\n",
+		(unsigned long) wakeups * 3600 / WAKEUP_REPORT, (unsigned long) expirations * 3600 / WAKEUP_REPORT);
+	sched_reset(&report_timer);
+}
+
+#if ENERGY_REPORTS
+// Timer of the energy reports
+static sched_timer_t energy_timer;
+
+/**
+ * Callback function that reports the energy spent since the last report, with the frames dropped by
+ * the queues and the size of the routing table: the root uploads it to the server, the other motes
+ * send it to their parent.
+ */
+static void energy_callback(void *ptr) {
+	ENERGY_message_t message;
+	uint8_t class;
+	energy_report(&message);
+	message.drops = rx_drops();
+	for (class = 0; class < TX_CLASSES; class++) {
+		message.drops += tx_drops(class);
+	}
+#if MOTE_ROUTER
+	message.routes = hashmap_length(mote.routing_table) < 255 ? hashmap_length(mote.routing_table) : 255;
+#else
+	message.routes = 0;
+#endif
+	if (mote.rank == 0) {
+#if MOTE_ROOT
+		energy_upload(&message);
+#endif
+	} else if (mote.in_dodag) {
+#if MOTE_NODE
+		send_ENERGY(&message, &mote);
+#endif
+	}
+	sched_reset(&energy_timer);
+}
+#endif
+
+/**
+ * Callback function that will send the appropriate message when the timer has expired.
+ */
+static void send_callback(void *ptr) {
+
+	// Send the appropriate message
+	if (!mote.in_dodag) {
+		// With TSCH, the DIS waits for the synchronization with the network
+		if (schedule_associated()) {
+			send_DIS();
+		}
+#if MOTE_ROUTER
+	} else if (mote_routes()) {
+		send_DIO(&mote);
+		// Update the trickle timer
+		trickle_update(&t_timer);
+#endif
+	} else {
+		// Nothing to advertise, reset_timers restarts the timer if the mote detaches
+		return;
+	}
+
+	// Restart the timer with a new random value
+	sched_set(&send_timer, trickle_random(&t_timer), SLACK_SEND, send_callback, NULL);
+
+}
+
+#if MOTE_NODE
+/**
+ * Callback function that will send a DAO message to the parent, if the mote is in the DODAG.
+ */
+static void DAO_callback(void *ptr) {
+	if (mote.in_dodag) {
+		send_DAO(&mote);
+	}
+	// Restart the timer with a new random value
+	sched_set(&DAO_timer, trickle_random(&t_timer), SLACK_DAO, DAO_callback, NULL);
+}
+#endif
+
+/**
+ * Resets the trickle timer and restarts the callback timers that use it.
+ * This function is called when there is a change in the network.
+ */
+void reset_timers() {
+	trickle_reset(&t_timer);
+	sched_set(&send_timer, trickle_random(&t_timer), SLACK_SEND,
+		send_callback, NULL);
+#if MOTE_NODE
+	if (mote.rank != 0) { // the root has no parent
+		sched_set(&DAO_timer, trickle_random(&t_timer), SLACK_DAO,
+			DAO_callback, NULL);
+	}
+#endif
+}
+
+#if MOTE_NODE
+/**
+ * Resets the trickle timer, and stops all timers for events that happen when the mote is in the network.
+ * This function is called when the mote detaches from the network.
+ */
+static void stop_timers() {
+	trickle_reset(&t_timer);
+	sched_set(&send_timer, trickle_random(&t_timer), SLACK_SEND,
+		send_callback, NULL);
+	sched_stop(&DAO_timer);
+	sched_stop(&parent_timer);
+#if MOTE_ROUTER
+	sched_stop(&children_timer);
+#endif
+	schedule_update(&mote);
+	power_allow_sleep(0);
+	if (role.detached != NULL) {
+		role.detached();
+	}
+}
+
+/**
+ * Callback function that will detach from the DODAG if the parent is lost.
+ */
+static void parent_callback(void *ptr) {
+	// Reset the timer
+	sched_reset(&parent_timer);
+
+	// Detach from DODAG only if node was already in DODAG
+	if (mote.in_dodag) {
+		// Detach from DODAG
+		detach(&mote);
+		// Reset and stop timers
+		stop_timers();
+	}
+
+}
+
+#if MOTE_LOW_POWER
+/**
+ * Callback function of the low-power mode, called for each unicast frame acknowledged.
+ * The radio being off most of the time, an ACK of the parent stands for its DIOs.
+ */
+static void parent_acked(const linkaddr_t *dest) {
+	if (mote.in_dodag && linkaddr_cmp(dest, &(mote.parent->addr))) {
+		sched_set(&parent_timer, CLOCK_SECOND*TIMEOUT_PARENT, SLACK_PARENT,
+			parent_callback, NULL);
+	}
+}
+#endif
+#endif
+
+#if MOTE_ROUTER
+/**
+ * Switches to leaf mode: stops advertising DIOs and sweeping the children, and frees the
+ * routing table. The mote still answers the DIS, so a new mote can attach to it.
+ */
+static void leaf_enter() {
+	mote.leaf = 1;
+	sched_stop(&children_timer);
+	hashmap_free(mote.routing_table);
+	mote.routing_table = NULL;
+	schedule_update(&mote);
+	LOG_INFO("Leaf mode on\n");
+}
+
+/**
+ * Callback function that will delete unresponsive children from the routing table.
+ * Switches to leaf mode if the mote has had no child for LEAF_SWEEPS sweeps.
+ */
+static void children_callback(void *ptr) {
+	// Reset the timer
+	sched_reset(&children_timer);
+
+	if (mote.in_dodag && hashmap_delete_timeout(mote.routing_table)) {
+		// Children have been deleted, reset sending timers
+		schedule_update(&mote);
+		reset_timers();
+	}
+
+	if (hashmap_length(mote.routing_table) > 0) {
+		childless_sweeps = 0;
+	} else if (role.leaf_auto && mote.in_dodag && ++childless_sweeps >= LEAF_SWEEPS) {
+		leaf_enter();
+	}
+
+}
+
+/**
+ * Leaves leaf mode when a child attaches: restores the routing table, the children timer and the DIOs.
+ */
+static void leaf_exit() {
+	mote.leaf = 0;
+	childless_sweeps = 0;
+	mote.routing_table = hashmap_new();
+	sched_set(&children_timer, CLOCK_SECOND*TIMEOUT_CHILDREN, SLACK_CHILDREN,
+		children_callback, NULL);
+	reset_timers();
+	LOG_INFO("Leaf mode off\n");
+}
+#endif
+
+
+
+//////////////////
+///  HANDLERS  ///
+//////////////////
+
+#if MOTE_ROUTER
+/**
+ * Adds the sender of a DAO to the routing table, and forwards it to the parent.
+ */
+void core_DAO(const void *data, uint16_t len, const linkaddr_t *from) {
+	DAO_message_t* message = (DAO_message_t*) data;
+
+	// Address of the mote that sent the DAO packet
+	linkaddr_t child_addr = message->src_addr;
+
+	if (mote.leaf) { // first child of a mote in leaf mode
+		leaf_exit();
+	}
+
+	int err = hashmap_put(mote.routing_table, child_addr, message->typeMote, *from, link_rss());
+	if (err == MAP_NEW || err == MAP_UPDATE) {
+		// The next hop towards the child may be new
+		schedule_update(&mote);
+
+#if MOTE_FORWARDER
+		// Forward DAO message to parent
+		if (mote.rank != 0) {
+			forward_DAO(message, &mote);
+		}
+#endif
+
+		if (err == MAP_NEW) { // A new child was added to the routing table
+			// Reset timers
+			reset_timers();
+		}
+
+	} else {
+		LOG_INFO("Error adding to routing table\n");
+	}
+}
+#endif
+
+#if MOTE_FORWARDER
+/**
+ * Forwards a LIGHT message towards the root.
+ */
+void core_LIGHT(const void *data, uint16_t len, const linkaddr_t *from) {
+	forward_LIGHT((LIGHT_message_t*) data, &mote);
+}
+
+/**
+ * Forwards an ACK message towards the root.
+ */
+void core_ACK(const void *data, uint16_t len, const linkaddr_t *from) {
+	forward_ACK((ACK_message_t*) data, rx_received(), &mote);
+}
+
+#if ENERGY_REPORTS
+/**
+ * Forwards an ENERGY message towards the root.
+ */
+void core_ENERGY(const void *data, uint16_t len, const linkaddr_t *from) {
+	if (mote.in_dodag) {
+		send_ENERGY((ENERGY_message_t*) data, &mote);
+	}
+}
+#endif
+#endif
+
+#if MOTE_ROUTER
+/**
+ * Forwards a MAINT message towards its destination.
+ */
+void core_MAINT(const void *data, uint16_t len, const linkaddr_t *from) {
+	MAINT_message_t* message = (MAINT_message_t*) data;
+	forward_MAINT(message->src_addr, &mote);
+}
+
+/**
+ * Forwards a MAINTACK message towards its destination.
+ */
+void core_MAINTACK(const void *data, uint16_t len, const linkaddr_t *from) {
+	forward_MAINTACK((MAINTACK_message_t*) data, &mote);
+}
+#endif
+
+#if MOTE_NODE
+/**
+ * Acts on an accepted TURNON command if it is for the type of the mote and the mote is one of
+ * its targets, then forwards it: the targets below this one also get the command.
+ */
+static void handle_TURNON(TURNON_message_t *message) {
+	if (message->typeMote == mote.typeMote && role.actuate != NULL
+			&& ack_bitmap_test(message->targets, mote.addr.u16[0] % ACK_BITMAP_BITS)) {
+		role.actuate(message->cmd_id, &(message->trace));
+	}
+#if MOTE_ROUTER
+	forward_TURNON(message, &mote);
+#endif
+}
+
+/**
+ * Handles a TURNON command sent in unicast: acts if it is for the type of the mote,
+ * and forwards it to the subtree.
+ */
+void core_TURNON(const void *data, uint16_t len, const linkaddr_t *from) {
+	TURNON_message_t* message = (TURNON_message_t*) data;
+	if (accept_TURNON(message, from, 0, &mote)) {
+		handle_TURNON(message);
+	}
+}
+
+/**
+ * Handles a TURNON command sent in broadcast. Only the broadcasts of the parent are for us.
+ */
+void core_TURNON_broadcast(const void *data, uint16_t len, const linkaddr_t *from) {
+	TURNON_message_t* message = (TURNON_message_t*) data;
+	if (accept_TURNON(message, from, 1, &mote)) {
+		handle_TURNON(message);
+	}
+}
+#endif
+
+#if TURNON_MPL
+/**
+ * Handles a multicast command: rebroadcasts it, and acts if it is new and for the type of the mote.
+ */
+void core_MPL(const void *data, uint16_t len, const linkaddr_t *from) {
+	MPL_message_t* message = (MPL_message_t*) data;
+	if (mpl_recv(message) && message->typeMote == mote.typeMote && role.actuate != NULL) {
+		role.actuate(message->seq, NULL);
+	}
+}
+#endif
+
+#if MOTE_ROUTER
+/**
+ * Answers a DIS with a DIO, if the mote is in the DODAG. Also in leaf mode.
+ */
+void core_DIS(const void *data, uint16_t len, const linkaddr_t *from) {
+	if (mote.in_dodag && role.router) {
+		send_DIO(&mote);
+	}
+}
+#endif
+
+#if MOTE_NODE
+/**
+ * Handles a DIO: updates the parent, or evaluates the sender as a new parent.
+ */
+void core_DIO(const void *data, uint16_t len, const linkaddr_t *from) {
+	DIO_message_t* message = (DIO_message_t*) data;
+
+	// Strength of the last received packet
+	signed char rss = link_rss();
+
+	if (mote.in_dodag && linkaddr_cmp(from, &(mote.parent->addr))) { // DIO message received from parent
+		if (message->rank == INFINITE_RANK) { // Parent has detached from the DODAG
+			detach(&mote);
+			stop_timers();
+		} else { // Update info
+			// Restart timer to delete lost parent
+			sched_set(&parent_timer, CLOCK_SECOND*TIMEOUT_PARENT, SLACK_PARENT,
+				parent_callback, NULL);
+			mote.parent->congested = message->congested;
+			if (update_parent(&mote, message->rank, rss, message->typeMote)) {
+				// Rank of parent has changed, advertise the new rank and reset trickle timer
+#if MOTE_ROUTER
+				if (mote_routes()) {
+					send_DIO(&mote);
+				}
+#endif
+				reset_timers();
+			}
+		}
+
+	} else {
+
+		// DIO message received from other mote, it is a potential parent
+		uint8_t code = choose_parent(&mote, from, message->rank, rss, message->typeMote);
+		if (code == PARENT_NEW) {
+			schedule_update(&mote);
+			reset_timers();
+			send_DAO(&mote);
+
+			// Start all timers that are used when mote is in DODAG
+			sched_set(&parent_timer, CLOCK_SECOND*TIMEOUT_PARENT, SLACK_PARENT,
+				parent_callback, NULL);
+#if MOTE_ROUTER
+			if (mote_routes()) {
+				sched_set(&children_timer, CLOCK_SECOND*TIMEOUT_CHILDREN, SLACK_CHILDREN,
+					children_callback, NULL);
+			}
+#endif
+			power_allow_sleep(1);
+			if (role.joined != NULL) {
+				role.joined();
+			}
+
+		} else if (code == PARENT_CHANGED) {
+			// If parent has changed, send DIO message to update children
+			// and DAO to update routing tables, then reset timers
+			schedule_update(&mote);
+#if MOTE_ROUTER
+			if (mote_routes()) {
+				send_DIO(&mote);
+			}
+#endif
+			send_DAO(&mote);
+			reset_timers();
+		}
+	}
+}
+#endif
+
+#if MOTE_TSCH
+/**
+ * TSCH_CALLBACK_JOINING_NETWORK: the mote is synchronized, it looks for a parent right away.
+ */
+void core_tsch_joined() {
+	reset_timers();
+}
+
+/**
+ * TSCH_CALLBACK_LEAVING_NETWORK: the mote has lost the synchronization, it leaves the DODAG.
+ */
+void core_tsch_left() {
+#if MOTE_NODE
+	if (mote.in_dodag && mote.rank != 0) {
+		detach(&mote);
+		stop_timers();
+	}
+#endif
+}
+#endif
+
+/**
+ * Callback function of the receive queue, hands the message to the handler of its type.
+ */
+static void dispatch(const void *data, uint16_t len,
+	const linkaddr_t *src, const linkaddr_t *dest)
+{
+	uint8_t type = *((uint8_t*) data);
+	uint8_t broadcast = linkaddr_cmp(dest, &linkaddr_null);
+	const handler_t *handlers = broadcast ? role.broadcast : role.unicast;
+
+	if (type >= MSG_TYPES) {
+		LOG_INFO("Unknown %s message received, type %u from %u\n",
+			broadcast ? "broadcast" : "runicast", type, src->u16[0]);
+	} else if (handlers[type] != NULL) {
+		handlers[type](data, len, src);
+	}
+}
+
+
+
+//////////////////////
+///  MAIN PROCESS  ///
+//////////////////////
+
+PROCESS(mote_process, "Mote");
+
+PROCESS_THREAD(mote_process, ev, data) {
+
+	PROCESS_BEGIN();
+
+	init_mote(&mote, role.typeMote);
+	schedule_init(&mote);
+	congestion_init(&mote, mote_routes());
+	trickle_init(&t_timer);
+	rx_init(dispatch);
+	power_init(parent_acked);
+
+	// Start the sending timer, the root is in the DODAG from the start
+	sched_set(&send_timer, trickle_random(&t_timer), SLACK_SEND,
+		send_callback, NULL);
+#if MOTE_ROOT
+	if (mote.rank == 0) {
+		sched_set(&children_timer, CLOCK_SECOND*TIMEOUT_CHILDREN, SLACK_CHILDREN,
+			children_callback, NULL);
+	}
+#endif
+
+	sched_set(&report_timer, CLOCK_SECOND*WAKEUP_REPORT, CLOCK_SECOND*WAKEUP_REPORT/10,
+		report_callback, NULL);
+#if ENERGY_REPORTS
+	energy_init();
+	sched_set(&energy_timer, CLOCK_SECOND*ENERGY_PERIOD, CLOCK_SECOND*ENERGY_PERIOD/10,
+		energy_callback, NULL);
+#endif
+
+	// The timers run in the context of this process, which must stay alive
+	while(1) {
+		PROCESS_YIELD();
+	}
+
+	PROCESS_END();
+
+}
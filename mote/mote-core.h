@@ -0,0 +1,164 @@
+/**
+ * Core shared by all the motes: the timers of the routing protocol, the main process, and the
+ * dispatch of the received messages.
+ *
+ * Each mote file only defines its role: a table of handlers for unicast messages and one for
+ * broadcast messages, indexed by the type of the message, and the hooks called by the core.
+ * The handlers common to several roles are defined here.
+ */
+
+#ifndef MOTE_CORE_H_
+#define MOTE_CORE_H_
+
+#include "routing.h"
+#include "trickle-timer.h"
+#include "scheduler.h"
+#include "dodag-schedule.h"
+#include "energy.h"
+#include "power.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Number of sweeps of the children timer without any child before switching to leaf mode
+#define LEAF_SWEEPS 2
+
+// Slack of the timers: how late they may expire to share a wakeup with another timer
+#define SLACK_SEND     (CLOCK_SECOND/2)
+#define SLACK_DAO      (CLOCK_SECOND*2)
+#define SLACK_PARENT   (CLOCK_SECOND*5)
+#define SLACK_CHILDREN (CLOCK_SECOND*15)
+#define SLACK_APP      (CLOCK_SECOND*5)	// data and actuator timers of the roles
+
+// Period of the report of the wakeups of the scheduler [sec]
+#define WAKEUP_REPORT 300
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Function handling a received message
+typedef void (*handler_t)(const void *data, uint16_t len, const linkaddr_t *from);
+
+// Represents the role of a mote, defined by each mote file
+typedef struct role {
+	uint8_t typeMote;
+	uint8_t router;		// 1 if the mote sends DIOs and accepts children
+	uint8_t leaf_auto;	// 1 if the mote switches to leaf mode when it has no children
+	const handler_t *unicast;	// MSG_TYPES handlers, NULL for the ignored messages
+	const handler_t *broadcast;
+	void (*actuate)(uint8_t cmd_id, trace_t *trace);	// command for the type of the mote, or NULL
+	void (*joined)();	// the mote has joined the DODAG, or NULL
+	void (*detached)();	// the mote has left the DODAG, or NULL
+} role_t;
+
+
+
+///////////////////
+///  VARIABLES  ///
+///////////////////
+
+// Role of the mote, defined by the mote file
+extern const role_t role;
+
+// Represents the attributes of this mote
+extern mote_t mote;
+
+// Trickle timer for the periodic messages
+extern trickle_timer_t t_timer;
+
+// Main process of the mote, to list in AUTOSTART_PROCESSES by the mote file
+PROCESS_NAME(mote_process);
+
+// 1 if the mote currently sends DIOs and keeps a routing table: known at compile time in a
+// role build without routing, 0 in leaf mode
+#if MOTE_ROLE == ROLE_ALL
+#define mote_routes() (role.router && !mote.leaf)
+#else
+#define mote_routes() (MOTE_ROUTER && !mote.leaf)
+#endif
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Resets the trickle timer and restarts the callback timers that use it.
+ * This function is called when there is a change in the network.
+ */
+void reset_timers();
+
+#if MOTE_TSCH
+/**
+ * TSCH_CALLBACK_JOINING_NETWORK: the mote is synchronized, it looks for a parent right away.
+ */
+void core_tsch_joined();
+
+/**
+ * TSCH_CALLBACK_LEAVING_NETWORK: the mote has lost the synchronization, it leaves the DODAG.
+ */
+void core_tsch_left();
+#endif
+
+/**
+ * Adds the sender of a DAO to the routing table, and forwards it to the parent.
+ */
+void core_DAO(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Forwards a LIGHT message towards the root.
+ */
+void core_LIGHT(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Forwards an ACK message towards the root.
+ */
+void core_ACK(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Forwards an ENERGY message towards the root.
+ */
+void core_ENERGY(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Forwards a MAINT message towards its destination.
+ */
+void core_MAINT(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Forwards a MAINTACK message towards its destination.
+ */
+void core_MAINTACK(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Handles a TURNON command sent in unicast: acts if it is for the type of the mote,
+ * and forwards it to the subtree.
+ */
+void core_TURNON(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Handles a TURNON command sent in broadcast. Only the broadcasts of the parent are for us.
+ */
+void core_TURNON_broadcast(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Handles a multicast command: rebroadcasts it, and acts if it is new and for the type of the mote.
+ */
+void core_MPL(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Answers a DIS with a DIO, if the mote is in the DODAG.
+ */
+void core_DIS(const void *data, uint16_t len, const linkaddr_t *from);
+
+/**
+ * Handles a DIO: updates the parent, or evaluates the sender as a new parent.
+ */
+void core_DIO(const void *data, uint16_t len, const linkaddr_t *from);
+
+#endif /* MOTE_CORE_H_ */
@@ -0,0 +1,201 @@
+/**
+ * MPL-style multicast of the TURNON commands, used for fleet-wide actuator commands.
+ */
+
+#include "mpl.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Represents a command of the duplicate cache, with its own Trickle timer
+typedef struct mpl_entry {
+	MPL_message_t message;
+	uint8_t in_use;
+	uint8_t active;		// 1 while the command is still rebroadcast
+	uint8_t expirations;
+	trickle_timer_t t_timer;
+	struct ctimer timer;		// at t, then at the end of the interval
+	clock_time_t interval_rest;	// time from t to the end of the interval
+} mpl_entry_t;
+
+// Duplicate cache
+static mpl_entry_t cache[MPL_CACHE_SIZE];
+
+// Last command removed from the cache. Older commands from the same seed are duplicates
+static linkaddr_t evicted_seed;
+static uint8_t evicted_seq;
+static uint8_t evicted = 0;
+
+// Sequence number of the last command originated by this mote
+static uint8_t last_seq = 0;
+
+// Number of MPL messages transmitted
+static uint16_t tx_count = 0;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Returns 1 if the sequence number a is newer than b, using serial number arithmetic.
+ */
+static uint8_t seq_newer(uint8_t a, uint8_t b) {
+	return (int8_t) (a - b) > 0;
+}
+
+/**
+ * Returns the cache entry of the given command, or NULL if it isn't in the cache.
+ */
+static mpl_entry_t* cache_lookup(const linkaddr_t *seed, uint8_t seq) {
+	int i;
+	for (i = 0; i < MPL_CACHE_SIZE; i++) {
+		if (cache[i].in_use && cache[i].message.seq == seq
+			&& linkaddr_cmp(&(cache[i].message.seed), seed)) {
+			return &cache[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns a free cache entry. If there isn't any, evicts an expired command,
+ * or the oldest one if all of them are still rebroadcast.
+ */
+static mpl_entry_t* cache_alloc() {
+	mpl_entry_t *victim = NULL;
+	int i;
+	for (i = 0; i < MPL_CACHE_SIZE; i++) {
+		if (!cache[i].in_use) {
+			return &cache[i];
+		}
+		if (!cache[i].active && (victim == NULL || seq_newer(victim->message.seq, cache[i].message.seq))) {
+			victim = &cache[i];
+		}
+	}
+	if (victim == NULL) {
+		victim = &cache[0];
+		for (i = 1; i < MPL_CACHE_SIZE; i++) {
+			if (seq_newer(victim->message.seq, cache[i].message.seq)) {
+				victim = &cache[i];
+			}
+		}
+		ctimer_stop(&(victim->timer));
+	}
+	linkaddr_copy(&evicted_seed, &(victim->message.seed));
+	evicted_seq = victim->message.seq;
+	evicted = 1;
+	return victim;
+}
+
+static void mpl_transmit(void *ptr);
+static void mpl_interval_end(void *ptr);
+
+/**
+ * Starts a Trickle interval of a command: its transmission point t is drawn in [I/2, I].
+ */
+static void mpl_interval_start(mpl_entry_t *entry) {
+	clock_time_t t = trickle_random(&(entry->t_timer));
+	entry->interval_rest = trickle_interval(&(entry->t_timer)) - t;
+	ctimer_set(&(entry->timer), t, mpl_transmit, entry);
+}
+
+/**
+ * Callback function, called at the transmission point t of each Trickle interval of a command.
+ * Rebroadcasts the command unless enough copies have been heard since the start of the interval.
+ */
+static void mpl_transmit(void *ptr) {
+	mpl_entry_t *entry = (mpl_entry_t*) ptr;
+
+	if (trickle_should_transmit(&(entry->t_timer), MPL_REDUNDANCY)) {
+		send_MPL(&(entry->message));
+		tx_count++;
+		LOG_INFO("MPL tx seq %u (%u sent)\n", entry->message.seq, tx_count);
+	}
+	ctimer_set(&(entry->timer), entry->interval_rest, mpl_interval_end, entry);
+}
+
+/**
+ * Callback function, called at the end of each Trickle interval of a command.
+ * Doubles the interval, which sets c back to 0, and starts the next one.
+ */
+static void mpl_interval_end(void *ptr) {
+	mpl_entry_t *entry = (mpl_entry_t*) ptr;
+
+	entry->expirations++;
+	if (entry->expirations >= MPL_EXPIRATIONS) {
+		// Keep the command in the cache to drop late duplicates, but stop rebroadcasting it
+		entry->active = 0;
+		return;
+	}
+
+	trickle_update(&(entry->t_timer));
+	mpl_interval_start(entry);
+}
+
+/**
+ * Adds a command to the cache and starts its Trickle timer.
+ */
+static void cache_add(MPL_message_t *message) {
+	mpl_entry_t *entry = cache_alloc();
+	memcpy(&(entry->message), message, MPL_size);
+	entry->in_use = 1;
+	entry->active = 1;
+	entry->expirations = 0;
+	trickle_init_range(&(entry->t_timer), MPL_UNIT, MPL_T_MIN, MPL_T_MAX);
+	mpl_interval_start(entry);
+}
+
+/**
+ * Creates a new command for the motes of the given typeMote, with this mote as seed,
+ * and starts flooding it. Returns the sequence number, that the actuators use as command ID.
+ */
+uint8_t mpl_originate(uint8_t typeMote) {
+	MPL_message_t message;
+	message.type = MPL;
+	linkaddr_copy(&(message.seed), &linkaddr_node_addr);
+	message.seq = ++last_seq;
+	message.typeMote = typeMote;
+
+	// The seed transmits right away, the Trickle timer takes care of the retransmissions
+	send_MPL(&message);
+	tx_count++;
+	LOG_INFO("MPL originated seq %u for type %u\n", message.seq, typeMote);
+
+	cache_add(&message);
+	return message.seq;
+}
+
+/**
+ * Processes a received MPL message.
+ * Returns 1 if the command is new (it must be delivered locally), 0 if it is a duplicate.
+ */
+uint8_t mpl_recv(MPL_message_t *message) {
+	mpl_entry_t *entry = cache_lookup(&(message->seed), message->seq);
+	if (entry != NULL) {
+		// Consistent copy, it may suppress our own rebroadcast
+		trickle_consistent(&(entry->t_timer));
+		return 0;
+	}
+	if (evicted && linkaddr_cmp(&evicted_seed, &(message->seed))
+		&& !seq_newer(message->seq, evicted_seq)) {
+		// Older than what has already left the cache
+		return 0;
+	}
+	cache_add(message);
+	return 1;
+}
+
+/**
+ * Returns the number of MPL messages transmitted by this mote.
+ */
+uint16_t mpl_tx_count() {
+	return tx_count;
+}
@@ -0,0 +1,59 @@
+/**
+ * MPL-style multicast of the TURNON commands, used for fleet-wide actuator commands.
+ *
+ * Instead of one unicast per next hop at every level (forward_TURNON), the command is
+ * broadcast by the root and rebroadcast by every mote under Trickle suppression (RFC 6206):
+ * in each interval I, the mote rebroadcasts at a random point t in [I/2, I] unless it has heard
+ * MPL_REDUNDANCY copies since the start of the interval, and I doubles at the end of it.
+ * A small cache of (seed, sequence number) pairs drops the duplicates.
+ */
+
+#ifndef MPL_H_
+#define MPL_H_
+
+#include "routing.h"
+#include "trickle-timer.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Number of commands kept in the duplicate cache
+#define MPL_CACHE_SIZE 4
+
+// Redundancy constant k: a mote doesn't rebroadcast if it has heard k copies during the interval
+#define MPL_REDUNDANCY 1
+
+// Number of Trickle intervals during which a command is rebroadcast
+#define MPL_EXPIRATIONS 3
+
+// Trickle range for the commands: T goes from 2 to 32 units of 1/16 second
+#define MPL_UNIT (CLOCK_SECOND/16)
+#define MPL_T_MIN 2
+#define MPL_T_MAX 32
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Creates a new command for the motes of the given typeMote, with this mote as seed,
+ * and starts flooding it. Returns the sequence number, that the actuators use as command ID.
+ */
+uint8_t mpl_originate(uint8_t typeMote);
+
+/**
+ * Processes a received MPL message.
+ * Returns 1 if the command is new (it must be delivered locally), 0 if it is a duplicate.
+ */
+uint8_t mpl_recv(MPL_message_t *message);
+
+/**
+ * Returns the number of MPL messages transmitted by this mote.
+ */
+uint16_t mpl_tx_count();
+
+#endif /* MPL_H_ */
@@ -0,0 +1,113 @@
+/**
+ * Low-power mode of the battery motes that route for nobody.
+ */
+
+#include "power.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+///////////////////
+///  VARIABLES  ///
+///////////////////
+
+// 1 when the radio may sleep between the transmissions
+static uint8_t sleep_allowed = 0;
+
+// 1 while a frame is handed to the MAC
+static uint8_t tx_busy = 0;
+
+// Callback timer of the end of the listening, and time of that end
+static struct ctimer listen_timer;
+static clock_time_t listen_end;
+
+// Function called with the receiver of each acknowledged unicast frame
+static void (*acked_callback)(const linkaddr_t *dest) = NULL;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Turns the radio on or off. With TSCH, the radio belongs to the MAC.
+ */
+static void radio_set(uint8_t on) {
+#if !MOTE_TSCH
+	if (on) {
+		NETSTACK_RADIO.on();
+	} else {
+		NETSTACK_RADIO.off();
+	}
+#endif
+}
+
+/**
+ * Callback function that turns the radio off at the end of the listening,
+ * unless a frame is being sent.
+ */
+static void listen_callback(void *ptr) {
+	if (sleep_allowed && !tx_busy) {
+		radio_set(0);
+	}
+}
+
+/**
+ * Starts the low-power mode, with the radio on. The given function is called with the
+ * receiver of each unicast frame acknowledged by the MAC.
+ */
+void power_init(void (*acked)(const linkaddr_t *dest)) {
+	acked_callback = acked;
+	sleep_allowed = 0;
+	radio_set(1);
+}
+
+/**
+ * Lets the radio sleep between the transmissions (1), or keeps it on (0).
+ */
+void power_allow_sleep(uint8_t allow) {
+	sleep_allowed = allow;
+	if (allow) {
+		power_listen(POWER_LISTEN);
+	} else {
+		ctimer_stop(&listen_timer);
+		radio_set(1);
+	}
+	LOG_INFO("Radio sleep %s\n", allow ? "on" : "off");
+}
+
+/**
+ * Keeps the radio on for the given time at least.
+ */
+void power_listen(clock_time_t duration) {
+	clock_time_t now = clock_time();
+	radio_set(1);
+	// Don't shorten a longer listening
+	if (ctimer_expired(&listen_timer) || duration > listen_end - now) {
+		listen_end = now + duration;
+		ctimer_set(&listen_timer, duration, listen_callback, NULL);
+	}
+}
+
+/**
+ * Called by the transmit queue before a frame is handed to the MAC.
+ */
+void power_tx_start() {
+	tx_busy = 1;
+	radio_set(1);
+}
+
+/**
+ * Called by the transmit queue when the MAC is done with a frame, with its receiver
+ * (NULL for a broadcast) and the status of the transmission.
+ */
+void power_tx_done(const linkaddr_t *dest, int status) {
+	tx_busy = 0;
+	if (dest != NULL && status == MAC_TX_OK && acked_callback != NULL) {
+		acked_callback(dest);
+	}
+	power_listen(POWER_LISTEN);
+}
@@ -0,0 +1,71 @@
+/**
+ * Low-power mode of the battery motes that route for nobody: the light sensor leaves and
+ * the mobile terminal (LOW_POWER=1 in the Makefile).
+ *
+ * Once the mote is in the DODAG, its radio is only on to send a frame, and for POWER_LISTEN
+ * after it, to receive the answers. The MCU then sleeps in LPM3, the deepest mode that keeps
+ * the clock of the timers running, until the next timer. The DIOs of the parent being rarely
+ * heard, the frames acknowledged by the parent also show that it is still there.
+ * With TSCH, the radio is already duty-cycled by the schedule and is left to the MAC.
+ * While the mote is out of the DODAG, the radio stays on to find a parent.
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Time the radio stays on after a transmission, to receive the answers
+#define POWER_LISTEN (CLOCK_SECOND/4)
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+#if MOTE_LOW_POWER
+
+/**
+ * Starts the low-power mode, with the radio on. The given function is called with the
+ * receiver of each unicast frame acknowledged by the MAC.
+ */
+void power_init(void (*acked)(const linkaddr_t *dest));
+
+/**
+ * Lets the radio sleep between the transmissions (1), or keeps it on (0).
+ */
+void power_allow_sleep(uint8_t allow);
+
+/**
+ * Keeps the radio on for the given time at least.
+ */
+void power_listen(clock_time_t duration);
+
+/**
+ * Called by the transmit queue before a frame is handed to the MAC.
+ */
+void power_tx_start();
+
+/**
+ * Called by the transmit queue when the MAC is done with a frame, with its receiver
+ * (NULL for a broadcast) and the status of the transmission.
+ */
+void power_tx_done(const linkaddr_t *dest, int status);
+
+#else
+
+#define power_init(acked)
+#define power_allow_sleep(allow)
+#define power_listen(duration)
+#define power_tx_start()
+#define power_tx_done(dest, status)
+
+#endif
+
+#endif /* POWER_H_ */
@@ -0,0 +1,24 @@
+/**
+ * Configuration of Contiki-NG for the motes.
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#if ENERGY_REPORTS
+// Needed by energy.c
+#define ENERGEST_CONF_ON 1
+#endif
+
+#if MOTE_TSCH
+// The schedule of dodag-schedule.h replaces the 6TiSCH minimal schedule
+#define TSCH_SCHEDULE_CONF_WITH_6TISCH_MINIMAL 0
+// dodag-schedule.c chooses the cell of each packet
+#define TSCH_CONF_WITH_LINK_SELECTOR 1
+#define TSCH_CALLBACK_PACKET_READY schedule_packet_ready
+// The DODAG follows the synchronization with the TSCH network (see mote-core.h)
+#define TSCH_CALLBACK_JOINING_NETWORK core_tsch_joined
+#define TSCH_CALLBACK_LEAVING_NETWORK core_tsch_left
+#endif
+
+#endif /* PROJECT_CONF_H_ */
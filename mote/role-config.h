@@ -0,0 +1,82 @@
+/**
+ * Features compiled in the firmware of each role.
+ *
+ * The Makefile gives the role with ROLE=<role>, which defines MOTE_ROLE. Only the code used by
+ * that role is compiled: a sprinkler has no originate_TURNON, the mobile terminal has no
+ * routing table nor DAO forwarding, etc. Without a role, every feature is compiled and each
+ * firmware chooses its behaviour at run time with its role_t (see mote-core.h).
+ */
+
+#ifndef ROLE_CONFIG_H_
+#define ROLE_CONFIG_H_
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Values of MOTE_ROLE
+#define ROLE_ALL        0
+#define ROLE_ROOT       1
+#define ROLE_SUBGATEWAY 2
+#define ROLE_LIGHT      3
+#define ROLE_SPRINKLER  4
+#define ROLE_LIGHTBULB  5
+#define ROLE_MOBILE     6
+
+#ifndef MOTE_ROLE
+#define MOTE_ROLE ROLE_ALL
+#endif
+
+// 1 to build a sensor or an actuator as a leaf: it never accepts children
+#ifndef MOTE_LEAF
+#define MOTE_LEAF 0
+#endif
+
+// 1 to let a sensor or an actuator built as a router switch to leaf mode when it has no children
+#ifndef LEAF_AUTO
+#define LEAF_AUTO 1
+#endif
+
+// 1 to build a light sensor leaf or a mobile terminal in low-power mode (see power.h)
+#ifndef MOTE_LOW_POWER
+#define MOTE_LOW_POWER 0
+#endif
+
+#if MOTE_ROLE == ROLE_ALL
+
+#define MOTE_ROOT       1
+#define MOTE_NODE       1
+#define MOTE_ROUTER     1
+#define MOTE_FORWARDER  1
+#define MOTE_AGGREGATOR 1
+#define MOTE_ACTUATOR   1
+#define MOTE_SENSOR     1
+#define MOTE_MOBILE     1
+
+#else
+
+// Originates the commands and reports to the server
+#define MOTE_ROOT       (MOTE_ROLE == ROLE_ROOT)
+// Has a parent: sends DAOs, maintains its parent
+#define MOTE_NODE       (MOTE_ROLE != ROLE_ROOT)
+// Merges the ACKs of its subtree
+#define MOTE_AGGREGATOR (MOTE_ROLE == ROLE_SUBGATEWAY)
+// Acts on the TURNON commands and acknowledges them
+#define MOTE_ACTUATOR   (MOTE_ROLE == ROLE_SPRINKLER || MOTE_ROLE == ROLE_LIGHTBULB)
+// Sends LIGHT messages
+#define MOTE_SENSOR     (MOTE_ROLE == ROLE_LIGHT)
+// Sends maintenance messages
+#define MOTE_MOBILE     (MOTE_ROLE == ROLE_MOBILE)
+// Sends DIOs and accepts children: has a routing table and forwards the commands down
+#define MOTE_ROUTER     (MOTE_ROOT || MOTE_AGGREGATOR || ((MOTE_ACTUATOR || MOTE_SENSOR) && !MOTE_LEAF))
+// Forwards the upward messages (DAO, LIGHT, ACK) of its children to its parent
+#define MOTE_FORWARDER  (MOTE_ROUTER && MOTE_NODE)
+
+#endif
+
+#if MOTE_LOW_POWER && (MOTE_ROUTER || !(MOTE_SENSOR || MOTE_MOBILE))
+#error "The low-power mode is for the light sensor leaves (LEAF=1) and the mobile terminal"
+#endif
+
+#endif /* ROLE_CONFIG_H_ */
@@ -2,228 +2,152 @@
  * Code for the gateway
  */
 
-#include "dev/leds.h"
+#include "mote-core.h"
+#include "mpl.h"
+#include "commands.h"
+#include "serial-protocol.h"
 
-#include "routing.h"
-#include "trickle-timer.h"
 
-#include <stdio.h>
-#include <stdlib.h>
-#include "random.h"
-#include "serial-line.h"
-#include "sys/log.h"
 
-#define LOG_MODULE "App"
-#define LOG_LEVEL LOG_LEVEL_INFO
+//////////////////
+///  HANDLERS  ///
+//////////////////
 
-// Represents the attributes of this mote
-mote_t mote;
-uint8_t created = 0;
-
-// Trickle timer for the periodic messages
-trickle_timer_t t_timer;
-
-
-
-/////////////////////////
-///  CALLBACK TIMERS  ///
-/////////////////////////
-
-// Callback timer to send information messages
-struct ctimer send_timer;
-
-// Callback timer to delete parent or children
-struct ctimer children_timer;
+// Trailer of an upward message, NULL without the path telemetry
+#if PATH_TELEMETRY
+#define PATH_OF(message) (&(message)->path)
+#else
+#define PATH_OF(message) NULL
+#endif
 
 /**
- * Callback function that will send the appropriate message when ctimer has expired.
+ * Reports an upward message to the server in a REC_PATH record: its source, the type of the
+ * source, and the trailer of the message if any.
  */
-void send_callback(void *ptr) {
-
-	// Send a DIO message
-	send_DIO(&mote);
-
-	// Update the trickle timer
-	trickle_update(&t_timer);
-
-	// Restart the timer with a new random value
-	ctimer_set(&send_timer, trickle_random(&t_timer), send_callback, NULL);
-
+static void report_path(uint8_t kind, const linkaddr_t *src, uint8_t typeMote, const path_trailer_t *path) {
+	serial_begin(REC_PATH);
+	serial_u8(kind);
+	serial_u16(src->u16[0]);
+	serial_u8(typeMote);
+	if (path != NULL) {
+		serial_u8(path->hops);
+		serial_u16(path->residence);
+	}
+	serial_end();
 }
 
 /**
- * Callback function that will delete unresponsive children from the routing table.
+ * Adds the sender of a DAO to the routing table, and reports it to the server with the path it took.
  */
-void children_callback(void *ptr) {
-	// Reset the timer
-	ctimer_reset(&children_timer);
-
-	// Delete children that haven't sent messages since a long time
-	if (hashmap_delete_timeout(mote.routing_table)) {
-		// Children have been deleted, reset trickle timer
-		trickle_reset(&t_timer);
-	}
-
+static void root_DAO(const void *data, uint16_t len, const linkaddr_t *from) {
+	core_DAO(data, len, from);
+	DAO_message_t* message = (DAO_message_t*) data;
+	report_path(REC_PATH_DAO, &(message->src_addr), message->typeMote, PATH_OF(message));
 }
 
 /**
- * Resets the trickle timer and restarts the callback timer that uses it (sending timer)
+ * The root mote (gateway) reports the acknowledged commands to the server.
  */
-void reset_timers(trickle_timer_t *timer) {
-	trickle_reset(&t_timer);
-	ctimer_set(&send_timer, trickle_random(&t_timer),
-		send_callback, NULL);
+static void root_ACK(const void *data, uint16_t len, const linkaddr_t *from) {
+	ACK_message_t* message = (ACK_message_t*) data;
+	report_path(REC_PATH_ACK, &(message->src_addr), message->typeMote, PATH_OF(message));
+	command_ACK(message);
 }
 
-
-
-////////////////////////////
-///  UNICAST CONNECTION  ///
-////////////////////////////
-
 /**
- * Callback function, called when an unicast packet is received
+ * Same as root_ACK, for the ACKs merged by a sub gateway.
  */
-void runicast_recv(const void* data, uint8_t len, const linkaddr_t *from) {
-
-	uint8_t* typePtr = (uint8_t*) data;
-	uint8_t type = *typePtr;
-
-	if (type == DAO) {
-		DAO_message_t* message = (DAO_message_t*) data;
-
-		// Address of the mote that sent the DAO packet
-		linkaddr_t child_addr = message->src_addr;
-
-		int err = hashmap_put(mote.routing_table, child_addr, message->typeMote, *from);
-		
-		if (err == MAP_NEW) { // A new child was added to the routing table
-			// Reset trickle timer and sending timer
-			reset_timers(&t_timer);
-		}
-
-
-	} else if (type == ACK) {
-		ACK_message_t* message = (ACK_message_t*) data;
-		if (mote.typeMote == 0){		
-			printf("Ack received from: \n");
-			printf("%u \n", message->typeMote);	
-		}
-		else{	//only the root mote (gateway) sends ack to the server
-			forward_ACK(message,&mote);	
-		}
-
-	} else if (type == LIGHT){
-		LIGHT_message_t* message = (LIGHT_message_t*) data;
-		if (mote.typeMote == 0){
-			printf("LIGHTSENSOR");	//Gateway indicates the server that it's sending the light level
-			printf("%u \n", message->light_level);
-			printf("LIGHTSENSOR");
-		}
-		else{
-			forward_LIGHT(message,&mote);	
-		}
-	} else if (type == MAINT){
-		MAINT_message_t* message = (MAINT_message_t*) data;
-		//root mote isn't supposed to receive maintenance message
-		forward_MAINT(message->src_addr, &mote);
-	} else if (type == MAINTACK){
-		MAINTACK_message_t* message = (MAINTACK_message_t*) data; //same for maintack	
-		forward_MAINTACK(message, &mote);
-	} else {
-		LOG_INFO("Unknown runicast message received. type is %u\n, from %u", type, from->u16[0]);
-	}
-
-
+static void root_ACKAGG(const void *data, uint16_t len, const linkaddr_t *from) {
+	command_ACKAGG((ACKAGG_message_t*) data);
 }
 
-//////////////////////////////
-///  BROADCAST CONNECTION  ///
-//////////////////////////////
-
 /**
- * Callback function, called when a broadcast packet is received
+ * Gateway indicates the server that it's sending the light level, with the sensor and the path it took.
  */
-void broadcast_recv(const void* data, uint16_t len, const linkaddr_t *from) {
-
-	uint8_t* typePtr = (uint8_t*) data;
-	uint8_t type = *typePtr;
-	if (type == DIS) {
-		// If the mote is already in a DODAG, send DIO packet
-		if (mote.in_dodag) {
-			send_DIO(&mote);
-		}
-	}
+static void root_LIGHT(const void *data, uint16_t len, const linkaddr_t *from) {
+	LIGHT_message_t* message = (LIGHT_message_t*) data;
+	serial_begin(REC_LIGHT);
+	serial_u16(message->src_addr.u16[0]);
+	serial_u16(message->light_level);
+#if PATH_TELEMETRY
+	serial_u8(message->path.hops);
+	serial_u16(message->path.residence);
+#endif
+	serial_end();
 }
 
-
+#if ENERGY_REPORTS
 /**
-* Send a MAINACK message to the dest addr given. If the dest mote (the mobile terminal) is not known locally, it is sent to the parent of the mote
-*/
-void input_callback(const void *data, uint16_t len,
-  const linkaddr_t *src, const linkaddr_t *dest)
-{
-	if (linkaddr_cmp(dest, &linkaddr_null)){
-		broadcast_recv(data, len, src);
-	}else{
-		runicast_recv(data,len,src);
-	}
+ * Gateway reports the energy spent by a mote to the server.
+ */
+static void root_ENERGY(const void *data, uint16_t len, const linkaddr_t *from) {
+	energy_upload((ENERGY_message_t*) data);
 }
+#endif
+
+static const handler_t unicast_handlers[MSG_TYPES] = {
+	[MSG_DAO] = root_DAO,
+	[MSG_ACK] = root_ACK,
+	[MSG_ACKAGG] = root_ACKAGG,
+	[MSG_LIGHT] = root_LIGHT,
+	[MSG_MAINT] = core_MAINT,
+	[MSG_MAINTACK] = core_MAINTACK,
+#if ENERGY_REPORTS
+	[MSG_ENERGY] = root_ENERGY,
+#endif
+};
+
+static const handler_t broadcast_handlers[MSG_TYPES] = {
+	[MSG_DIS] = core_DIS,
+#if TURNON_MPL
+	[MSG_MPL] = core_MPL,	// copy of a command we originated, counts towards the Trickle suppression
+#endif
+};
+
+const role_t role = {
+	.typeMote = 0,
+	.router = 1,
+	.unicast = unicast_handlers,
+	.broadcast = broadcast_handlers,
+};
+
 
 
 //////////////////////
 ///  MAIN PROCESS  ///
 //////////////////////
 
-// Create and start the process
-PROCESS(root_mote, "Root mote");
+// Create and start the processes
 PROCESS(server_communication, "Server communication");
 
-AUTOSTART_PROCESSES(&root_mote, &server_communication);
-
-PROCESS_THREAD(root_mote, ev, data) {
+AUTOSTART_PROCESSES(&mote_process, &server_communication);
 
-	if (!created) {
-		init_mote(&mote, 0);
-		trickle_init(&t_timer);
-		created = 1;
+/**
+ * Handles a record received from the server: a REC_COMMAND turns on the actuators of
+ * its typeMote (3 for the sprinklers, 4 for the light bulbs) that are off or about to go off.
+ * The multicast can't target them: all the actuators of the type get it.
+ */
+static void server_record(uint8_t type, const uint8_t *value, uint8_t len) {
+	if (type == REC_COMMAND && len >= 1) {
+		uint8_t typeMote = value[0];
+		uint8_t targets[ACK_BITMAP_BYTES];
+		if (!command_targets(typeMote, targets, &mote)) {
+			return;
+		}
+#if TURNON_MPL
+		command_sent(mpl_originate(typeMote), typeMote, targets);
+#else
+		command_sent(originate_TURNON(typeMote, targets, &mote), typeMote, targets);
+#endif
 	}
+}
 
+PROCESS_THREAD(server_communication, ev, data) {
 	PROCESS_BEGIN();
-
-	nullnet_set_input_callback(input_callback);
-
+	serial_init(&server_communication);
 	while(1) {
-
-		// Start all the timers
-		ctimer_set(&send_timer, trickle_random(&t_timer),
-			send_callback, NULL);
-		ctimer_set(&children_timer, CLOCK_SECOND*TIMEOUT_CHILDREN,
-			children_callback, NULL);
-
-		// Wait for the ctimer to trigger
-		PROCESS_YIELD();
-
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+		serial_input(server_record);
 	}
-
 	PROCESS_END();
 }
-
-PROCESS_THREAD(server_communication, ev, data) {
-    PROCESS_BEGIN();
-	serial_line_init();
-  	uart0_set_input(serial_line_input_byte);
-    nullnet_set_input_callback(input_callback);
-    while(1) {
-        PROCESS_YIELD();
-        if(ev==serial_line_event_message){ //if the message received from the server is "water": we send to the typemote 3 (the sprinkler) to turn on
-		if (strcmp((char*) data, "WATER") == 0) {	
-			forward_TURNON(3, &mote);		  
-    		}    		
-		if (strcmp((char*) data, "LIGHTBULBS") == 0) { //if it is "lightbulbs": to the typemote 4 (lightbulbs)
-			forward_TURNON(4, &mote);
-   		}	  
-    	}
-    }
-    PROCESS_END();
-}
@@ -3,6 +3,9 @@
  */
 
 #include "routing.h"
+#include "tx-queue.h"
+#include "rx-queue.h"
+#include "scheduler.h"
 #include "sys/log.h"
 
 #define LOG_MODULE "App"
@@ -13,14 +16,17 @@
 ///////////////////
 
 // Values for the different types of RPL control messages
-const uint8_t DIS = 2;
-const uint8_t DIO = 3;
-const uint8_t DAO = 4;
-const uint8_t TURNON = 5;
-const uint8_t ACK = 6;
-const uint8_t LIGHT = 7;
-const uint8_t MAINT = 8;
-const uint8_t MAINTACK = 9;
+const uint8_t DIS = MSG_DIS;
+const uint8_t DIO = MSG_DIO;
+const uint8_t DAO = MSG_DAO;
+const uint8_t TURNON = MSG_TURNON;
+const uint8_t ACK = MSG_ACK;
+const uint8_t LIGHT = MSG_LIGHT;
+const uint8_t MAINT = MSG_MAINT;
+const uint8_t MAINTACK = MSG_MAINTACK;
+const uint8_t MPL = MSG_MPL;
+const uint8_t ACKAGG = MSG_ACKAGG;
+const uint8_t ENERGY = MSG_ENERGY;
 
 
 
@@ -33,11 +39,64 @@ const size_t LIGHT_size = sizeof(LIGHT_message_t);
 const size_t ACK_size = sizeof(ACK_message_t);
 const size_t MAINT_size = sizeof(MAINT_message_t);
 const size_t MAINTACK_size = sizeof(MAINTACK_message_t);
+const size_t MPL_size = sizeof(MPL_message_t);
+const size_t ACKAGG_size = sizeof(ACKAGG_message_t);
+const size_t ENERGY_size = sizeof(ENERGY_message_t);
+
+// Mote whose congestion is watched, and timer of the check
+static mote_t *congestion_mote;
+static uint8_t congestion_advertised;
+static sched_timer_t congestion_timer;
 
 ///////////////////
 ///  FUNCTIONS  ///
 ///////////////////
 
+/**
+ * Callback function that updates the congestion state advertised by the mote: congested
+ * if its own transmit queue is, or if its parent advertises a congestion. A change is
+ * advertised at once with a DIO, so the sensors of the subtree slow down without waiting
+ * for the trickle timer.
+ */
+static void congestion_callback(void *ptr) {
+	mote_t *mote = congestion_mote;
+	uint8_t congested = tx_congested();
+	if (mote->in_dodag && mote->rank != 0 && mote->parent->congested) {
+		congested = 1;
+	}
+
+	if (congested != mote->congested) {
+		mote->congested = congested;
+		LOG_INFO("Congestion %s (data queue %u, drops %u)\n", congested ? "on" : "off",
+			tx_length(TX_CLASS_DATA), tx_drops(TX_CLASS_DATA));
+#if MOTE_ROUTER
+		if (mote->in_dodag && congestion_advertised && !mote->leaf) {
+			send_DIO(mote);
+		}
+#endif
+	}
+	sched_reset(&congestion_timer);
+}
+
+/**
+ * Starts watching the congestion of a mote. A router advertises the changes to its children.
+ */
+void congestion_init(mote_t *mote, uint8_t advertise) {
+	congestion_mote = mote;
+	congestion_advertised = advertise;
+	sched_set(&congestion_timer, CONGESTION_CHECK, CONGESTION_CHECK, congestion_callback, NULL);
+}
+
+/**
+ * Forgets the TURNON commands received: their IDs are only meaningful in the DODAG and behind the
+ * parent they came from.
+ */
+static void forget_cmds(mote_t *mote) {
+	memset(mote->recent_cmds, 0, RECENT_CMDS);
+	memset(mote->recent_cmds_time, 0, sizeof(mote->recent_cmds_time));
+	mote->recent_cmds_next = 0;
+}
+
 /**
  * Initializes the attributes of a mote.
  */
@@ -46,12 +105,19 @@ void init_mote(mote_t *mote, uint8_t typeMote) {
 	// Set the Rime address
 	linkaddr_copy(&(mote->addr), &linkaddr_node_addr);
 
+	// Start sending the frames of the transmit queue
+	tx_init();
+
+#if MOTE_ROUTER
 	// Initialize routing table
 	mote->routing_table = hashmap_new();
 
 	if (!mote->routing_table) {
 		exit(-1);
 	}
+#else
+	mote->routing_table = NULL;
+#endif
 	if (typeMote == 0){
 		mote->in_dodag = 1;
 		mote->rank = 0;
@@ -60,10 +126,95 @@ void init_mote(mote_t *mote, uint8_t typeMote) {
 		mote->rank = INFINITE_RANK;		
 	}
 	mote->typeMote = typeMote;
+	forget_cmds(mote);
+	mote->congested = 0;
+	mote->report_scale = 1;
+	mote->leaf = !MOTE_ROUTER;
+
+}
+
+/**
+ * Returns the signal strength of the frame being processed (in dBm).
+ */
+signed char link_rss() {
+	return rx_rss();
+}
+
+#if MOTE_SENSOR
+/**
+ * Returns the reporting period of a sensor, scaled up while its path to the root is
+ * congested: the factor doubles at each report sent during a congestion, and goes back
+ * down by one at each report sent once the congestion has cleared.
+ */
+clock_time_t report_interval(mote_t *mote, clock_time_t period) {
+	if (mote->congested) {
+		if (mote->report_scale < REPORT_SCALE_MAX) {
+			mote->report_scale *= 2;
+		}
+	} else if (mote->report_scale > 1) {
+		mote->report_scale--;
+	}
+	return period * mote->report_scale;
+}
+#endif
+
+/**
+ * Adds the time a frame waited in the transmit queue to the residence time of its
+ * trailer, or to the delay of this mote in its trace. Called when the frame leaves the queue.
+ */
+void stamp_queue_delay(uint8_t *frame, uint16_t len, clock_time_t waited) {
+	uint8_t type = frame[0];
+	unsigned long waited_ms = (unsigned long) waited * 1000 / CLOCK_SECOND;
+
+	if (type == TURNON) {
+		trace_t *trace = &(((TURNON_message_t*) frame)->trace);
+		// Only if the last record is the one of this mote (not sent by the root)
+		if (trace->hops > 0 && trace->hops <= TRACE_MAX_HOPS) {
+			unsigned long delay = trace->hop[trace->hops-1].delay + waited_ms / TRACE_DELAY_UNIT;
+			trace->hop[trace->hops-1].delay = delay > 255 ? 255 : delay;
+		}
+	}
+
+#if PATH_TELEMETRY
+	path_trailer_t *path = NULL;
+	if (type == DAO) {
+		path = &(((DAO_message_t*) frame)->path);
+	} else if (type == LIGHT) {
+		path = &(((LIGHT_message_t*) frame)->path);
+	} else if (type == ACK) {
+		path = &(((ACK_message_t*) frame)->path);
+	}
+	// Only for forwarded frames, the time spent in the source isn't part of the path
+	if (path != NULL && path->hops > 0) {
+		unsigned long residence = path->residence + waited_ms;
+		path->residence = residence > 65535 ? 65535 : residence;
+	}
+#endif
+}
 
+#if PATH_TELEMETRY
+/**
+ * Initializes the trailer of an upward message sent by this mote.
+ */
+void path_init(path_trailer_t *path) {
+	path->hops = 0;
+	path->residence = 0;
+}
+
+/**
+ * Adds this mote, and the time the message spent in it since it was received, to the trailer of an upward message.
+ */
+void path_stamp(path_trailer_t *path, clock_time_t received) {
+	unsigned long residence = path->residence + (unsigned long) (clock_time() - received) * 1000 / CLOCK_SECOND;
+	path->residence = residence > 65535 ? 65535 : residence;
+	if (path->hops < 255) {
+		path->hops++;
+	}
 }
+#endif
 
 
+#if MOTE_NODE
 /**
  * Initializes the parent of a mote.
  */
@@ -77,10 +228,12 @@ void init_parent(mote_t *mote, const linkaddr_t *parent_addr, uint8_t parent_ran
 	mote->parent->rank = parent_rank;
 	mote->parent->rss = rss;
 	mote->parent->typeMote = typeMote;
+	mote->parent->congested = 0;
 
 	// Update the attributes of the mote
 	mote->in_dodag = 1;
 	mote->rank = parent_rank + 1;
+	forget_cmds(mote);
 
 }
 
@@ -112,9 +265,11 @@ void change_parent(mote_t *mote, const linkaddr_t *parent_addr, uint8_t parent_r
 	mote->parent->rank = parent_rank;
 	mote->parent->rss = rss;
 	mote->parent->typeMote = typeMote;
+	mote->parent->congested = 0;
 
 	// Update the rank of the mote
 	mote->rank = parent_rank + 1;
+	forget_cmds(mote);
 
 }
 
@@ -126,12 +281,18 @@ void change_parent(mote_t *mote, const linkaddr_t *parent_addr, uint8_t parent_r
 void detach(mote_t *mote) {
 	if (mote->in_dodag) { // No need to detach the mote if it isn't already in the DODAG
 		free(mote->parent);
-		hashmap_free(mote->routing_table);
 		mote->in_dodag = 0;
 		mote->rank = INFINITE_RANK;
-		mote->routing_table = hashmap_new();
+		forget_cmds(mote);
+#if MOTE_ROUTER
+		if (mote->routing_table != NULL) { // no routing table in leaf mode
+			hashmap_free(mote->routing_table);
+			mote->routing_table = hashmap_new();
+		}
+#endif
 	}
 }
+#endif
 
 /**
  * Broadcasts a DIS message.
@@ -140,18 +301,12 @@ void send_DIS() {
 
 	DIS_message_t *message = (DIS_message_t*) malloc(DIS_size);
 	message->type = DIS;
-	//memcpy(nullnet_buf, (void*) message, DIS_size);
-	nullnet_buf = (uint8_t*) message;	
-	nullnet_len = DIS_size;
-
-	//packetbuf_copyfrom((void*) message, DIS_size);
+	tx_enqueue(TX_CLASS_CONTROL, message, DIS_size, NULL);
 	free(message);
-	NETSTACK_NETWORK.output(NULL);
-
-	//broadcast_send(conn);
 
 }
 
+#if MOTE_ROUTER
 /**
  * Broadcasts a DIO message, containing the rank of the node.
  */
@@ -164,17 +319,14 @@ void send_DIO(mote_t *mote) {
 	message->type = DIO;
 	message->rank = rank;
 	message->typeMote = type;
-	nullnet_buf = (uint8_t*) message;
-
-	nullnet_len = DIO_size;
-
-
+	message->congested = mote->congested;
+	tx_enqueue(TX_CLASS_CONTROL, message, DIO_size, NULL);
 	free(message);
-	NETSTACK_NETWORK.output(NULL);
-
 
 }
+#endif
 
+#if MOTE_NODE
 /**
  * Sends a DAO message to the parent of this node.
  */
@@ -184,26 +336,28 @@ void send_DAO(mote_t *mote) {
 	message->type = DAO;
 	message->src_addr = mote->addr;
 	message->typeMote = mote->typeMote;
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = DAO_size;
-
-
+#if PATH_TELEMETRY
+	path_init(&(message->path));
+#endif
+	tx_enqueue(TX_CLASS_CONTROL, message, DAO_size, &(mote->parent->addr));
 	free(message);
 
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
-
 }
+#endif
 
+#if MOTE_FORWARDER
 /**
  * Forwards a DAO message, to the parent of this node.
  */
 void forward_DAO(DAO_message_t *message, mote_t *mote) {
-	nullnet_buf = (uint8_t*) message;	
-	nullnet_len = DAO_size;
-
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
+#if PATH_TELEMETRY
+	path_stamp(&(message->path), rx_received());
+#endif
+	tx_enqueue(TX_CLASS_CONTROL, message, DAO_size, &(mote->parent->addr));
 }
+#endif
 
+#if MOTE_NODE
 /**
  * Returns 1 if the potential parent is better than the current parent, 0 otherwise.
  * A parent is better than another if it has a lower rank, or if it has the same rank
@@ -252,7 +406,9 @@ uint8_t choose_parent(mote_t *mote, const linkaddr_t* parent_addr, uint8_t paren
 	}
 	return PARENT_NOT_CHANGED;
 }
+#endif
 
+#if MOTE_SENSOR
 /**
  * Sends a LIGHT message, containing a random value, to the parent of the mote.
  */
@@ -261,86 +417,289 @@ void send_LIGHT(mote_t *mote) {
 	LIGHT_message_t *message = (LIGHT_message_t*) malloc(LIGHT_size);
 	message->type = LIGHT;
 	message->light_level = (uint16_t) (random_rand() % 250);
+	message->src_addr = mote->addr;
+#if PATH_TELEMETRY
+	path_init(&(message->path));
+#endif
 
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = LIGHT_size;
-
+	tx_enqueue(TX_CLASS_DATA, message, LIGHT_size, &(mote->parent->addr));
 	free(message);
 
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
-
 }
+#endif
 
+#if MOTE_FORWARDER
 /**
  * Forwards a LIGHT message to the parent of the mote.
  */
 void forward_LIGHT(LIGHT_message_t *message, mote_t *mote) {
-	nullnet_buf = (uint8_t*) message;	
-	nullnet_len = LIGHT_size;
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
+#if PATH_TELEMETRY
+	path_stamp(&(message->path), rx_received());
+#endif
+	tx_enqueue(TX_CLASS_DATA, message, LIGHT_size, &(mote->parent->addr));
 }
+#endif
+#if MOTE_ROUTER
 /**
-* Sends a TURNON message to the mote in param, including the typeMote given in param
+* Sends a TURNON message to the mote in param
 */
-void send_TURNON(uint8_t typeMote, linkaddr_t dest, mote_t *mote) {
-	TURNON_message_t* message = (TURNON_message_t*) malloc(TURNON_size);
-	message->type = TURNON;
-	message->typeMote = typeMote;
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = TURNON_size;
+void send_TURNON(TURNON_message_t *message, linkaddr_t dest) {
+	trace_stamp(&(message->trace));
+	tx_enqueue(TX_CLASS_COMMAND, message, TURNON_size, &dest);
+}
 
-	free(message);
+/**
+* Broadcasts a TURNON message. Only the children of this mote act on it
+*/
+void broadcast_TURNON(TURNON_message_t *message) {
+	trace_stamp(&(message->trace));
+	tx_enqueue(TX_CLASS_COMMAND, message, TURNON_size, NULL);
+}
+#endif
 
-	NETSTACK_NETWORK.output(&dest);
+#if MOTE_ROOT
+/**
+* Creates a new TURNON command for the actuators of the given typeMote in the targets bitmap,
+* and forwards it. Used by the root.
+* Returns the command ID.
+*/
+uint8_t originate_TURNON(uint8_t typeMote, const uint8_t *targets, mote_t *mote) {
+	static uint8_t last_cmd_id = 0;
+
+	TURNON_message_t message;
+	message.type = TURNON;
+	message.typeMote = typeMote;
+	// 0 is never used, it is the initial value of the recent commands
+	if (++last_cmd_id == 0) {
+		last_cmd_id = 1;
+	}
+	message.cmd_id = last_cmd_id;
+	memcpy(message.targets, targets, ACK_BITMAP_BYTES);
+	message.trace.hops = 0;
+
+	forward_TURNON(&message, mote);
+	return message.cmd_id;
 }
+#endif
 
+#if MOTE_ACTUATOR
 /**
-* Sends an ACK message to the parent of the mote
+* Sends an ACK message for the given command to the parent of the mote
 */
-void send_ACK(mote_t *mote) {
+void send_ACK(mote_t *mote, uint8_t cmd_id, trace_t *trace) {
 	ACK_message_t* message = (ACK_message_t*) malloc(ACK_size);
 	message->type = ACK;
 	message->typeMote = mote->typeMote;
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = ACK_size;
-
+	message->cmd_id = cmd_id;
+	message->src_addr = mote->addr;
+	if (trace != NULL) {
+		trace_stamp(trace);
+		memcpy(&(message->trace), trace, sizeof(trace_t));
+	} else {
+		message->trace.hops = 0;
+	}
+#if PATH_TELEMETRY
+	path_init(&(message->path));
+#endif
+	tx_enqueue(TX_CLASS_COMMAND, message, ACK_size, &(mote->parent->addr));
 	free(message);
+}
+#endif
+#if MOTE_FORWARDER
+/**
+* forwards an ACK message to the parent of the mote, received at the given time
+*/
+void forward_ACK(ACK_message_t *message, clock_time_t received, mote_t *mote){
+#if PATH_TELEMETRY
+	path_stamp(&(message->path), received);
+#endif
+	tx_enqueue(TX_CLASS_COMMAND, message, ACK_size, &(mote->parent->addr));
+}
+#endif
 
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
+#if MOTE_AGGREGATOR
+/**
+* Sends or forwards an ACKAGG message to the parent of the mote
+*/
+void forward_ACKAGG(ACKAGG_message_t *message, mote_t *mote) {
+	tx_enqueue(TX_CLASS_COMMAND, message, ACKAGG_size, &(mote->parent->addr));
 }
+#endif
+
+#if MOTE_AGGREGATOR || MOTE_ROOT
 /**
-* forwards an ACK message to the parent of the mote
+* Sets the bit of the given address in a bitmap of acknowledged motes
 */
-void forward_ACK(ACK_message_t *message, mote_t *mote){
-	nullnet_buf = (uint8_t*) message;	
-	nullnet_len = ACK_size;
-	NETSTACK_NETWORK.output(&(mote->parent->addr));
+void ack_bitmap_set(uint8_t *bitmap, const linkaddr_t *addr) {
+	unsigned i = addr->u16[0] % ACK_BITMAP_BITS;
+	bitmap[i/8] |= 1 << (i%8);
 }
+#endif
+
 /**
-* forward TURNON message to all the motes of the given typeMote known locally
+* Returns 1 if the bit i is set in a bitmap of motes (acknowledged or targets), 0 otherwise
 */
-void forward_TURNON(uint8_t typeMote, mote_t *mote) {	
-	// Address of the next-hop mote towards destination
+uint8_t ack_bitmap_test(const uint8_t *bitmap, unsigned i) {
+	return (bitmap[i/8] >> (i%8)) & 1;
+}
 
+#if MOTE_ROUTER
+/**
+* forward TURNON message to all the target motes of the given typeMote known locally.
+* Chooses between one unicast per next hop and a single broadcast, depending on the fan-out,
+* the quality of the links and the number of neighbours that would have to drop the broadcast.
+*/
+void forward_TURNON(TURNON_message_t *message, mote_t *mote) {
+	if (mote->routing_table == NULL) { // leaf mode, no subtree
+		return;
+	}
 	hashmap_element* map = mote->routing_table->data;
 	int i;
+	unsigned j;
+
+	// Next hops towards the motes of the given type, with the weakest rss seen for each of them.
+	// Static, not on the stack: the routing table can be much larger than the neighbourhood
+	static linkaddr_t dst[TURNON_NEIGHBOURS];
+	static signed char rss[TURNON_NEIGHBOURS];
 	unsigned index = 0;
-	linkaddr_t dst[mote->routing_table->table_size];
-	for (i = 0; i < mote->routing_table-> table_size; i++) {
+	uint8_t overflow = 0;	// 1 if some next hops did not fit
+
+	// Neighbours that would receive a broadcast without being a next hop
+	static linkaddr_t other[TURNON_NEIGHBOURS];
+	unsigned others = 0;
+
+	for (i = 0; i < mote->routing_table->table_size; i++) {
 		hashmap_element elem = *(map+i);
-		if (elem.in_use && elem.typeMote == typeMote) {
-			if(!isInArray(dst, index, &elem.data)){
+		if (!elem.in_use) {
+			continue;
+		}
+		if (elem.typeMote == message->typeMote && ack_bitmap_test(message->targets, elem.key % ACK_BITMAP_BITS)) {
+			for (j = 0; j < index && !linkaddr_cmp(&dst[j], &elem.data); j++);
+			if (j == index && index == TURNON_NEIGHBOURS) {
+				overflow = 1;
+			} else if (j == index) {
 				dst[index] = elem.data;
+				rss[index] = elem.rss;
 				index++;
+			} else if (elem.rss < rss[j]) {
+				rss[j] = elem.rss;
 			}
 		}
 	}
-	for (i = 0; i < index; i++) {
-		send_TURNON(typeMote, dst[i], mote);
+	for (i = 0; i < mote->routing_table->table_size; i++) {
+		hashmap_element elem = *(map+i);
+		if (others < TURNON_NEIGHBOURS && elem.in_use
+			&& !isInArray(dst, index, &elem.data) && !isInArray(other, others, &elem.data)) {
+			other[others] = elem.data;
+			others++;
+		}
+	}
+	if (mote->typeMote != 0 && mote->in_dodag) {
+		others++; // the parent also hears the broadcast
+	}
+
+	if (index == 0) {
+		return;
+	}
+
+	// Cost of the unicasts, and of a broadcast followed by a repair for each weak link
+	unsigned unicast_cost = 0;
+	unsigned broadcast_cost = COST_FRAME + others*COST_DROP;
+	unsigned repairs = 0;
+	for (j = 0; j < index; j++) {
+		if (rss[j] >= RSS_GOOD_LINK) {
+			unicast_cost += COST_FRAME;
+		} else {
+			unicast_cost += COST_WEAK_FRAME;
+			broadcast_cost += COST_WEAK_FRAME;
+			repairs++;
+		}
+	}
+
+	// The next hops that did not fit are only reached by a broadcast
+	if (overflow || (index > 1 && broadcast_cost < unicast_cost)) {
+		broadcast_TURNON(message);
+		// Targeted repair for the next hops that are likely to miss the broadcast
+		for (j = 0; j < index; j++) {
+			if (rss[j] < RSS_GOOD_LINK) {
+				send_TURNON(message, dst[j]);
+			}
+		}
+		LOG_INFO("TURNON cmd %u type %u broadcast to %u next hops, %u repairs\n",
+			message->cmd_id, message->typeMote, index, repairs);
+	} else {
+		for (j = 0; j < index; j++) {
+			send_TURNON(message, dst[j]);
+		}
+		LOG_INFO("TURNON cmd %u type %u sent to %u next hops\n", message->cmd_id, message->typeMote, index);
+	}
+}
+#endif
+
+#if MOTE_NODE
+/**
+* Returns 1 if a received TURNON message must be handled, 0 if it must be dropped.
+* A broadcast TURNON is only for the children of the sender, and the copies of a command
+* already handled (broadcast followed by a repair) are dropped.
+*/
+uint8_t accept_TURNON(TURNON_message_t *message, const linkaddr_t *from, uint8_t broadcast, mote_t *mote) {
+	if (broadcast && (!mote->in_dodag || !linkaddr_cmp(from, &(mote->parent->addr)))) {
+		return 0;
+	}
+	unsigned i;
+	for (i = 0; i < RECENT_CMDS; i++) {
+		if (mote->recent_cmds[i] == message->cmd_id
+			&& clock_time() - mote->recent_cmds_time[i] < RECENT_CMDS_LIFETIME) {
+			return 0;
+		}
+	}
+	mote->recent_cmds[mote->recent_cmds_next] = message->cmd_id;
+	mote->recent_cmds_time[mote->recent_cmds_next] = clock_time();
+	mote->recent_cmds_next = (mote->recent_cmds_next + 1) % RECENT_CMDS;
+	trace_hop(&(message->trace), mote);
+	return 1;
+}
+
+/**
+* Adds the record of this mote to the trace of a command it has just received
+*/
+void trace_hop(trace_t *trace, mote_t *mote) {
+	if (trace->hops < TRACE_MAX_HOPS) {
+		trace->hop[trace->hops].node = mote->addr.u8[0];
+		trace->hop[trace->hops].delay = 0;
+	}
+	if (trace->hops < 255) {
+		trace->hops++;
+	}
+}
+#endif
+
+/**
+* Updates the delay of the last record of a trace, just before the command leaves the mote
+*/
+void trace_stamp(trace_t *trace) {
+	if (trace->hops == 0 || trace->hops > TRACE_MAX_HOPS) {
+		return; // sent by the root, or the record of this mote didn't fit
+	}
+	unsigned long delay = (unsigned long) (clock_time() - rx_received()) * 1000 / CLOCK_SECOND / TRACE_DELAY_UNIT;
+	trace->hop[trace->hops-1].delay = delay > 255 ? 255 : delay;
+}
+
+#if MOTE_ROOT || MOTE_AGGREGATOR
+/**
+* Returns the sum of the delays recorded in a trace [ms]
+*/
+unsigned long trace_delay(trace_t *trace) {
+	unsigned long delay = 0;
+	unsigned i;
+	for (i = 0; i < trace->hops && i < TRACE_MAX_HOPS; i++) {
+		delay += trace->hop[i].delay;
 	}
-	memset(dst, 0, sizeof(linkaddr_t)*index);
+	return delay * TRACE_DELAY_UNIT;
 }
+#endif
 
+#if MOTE_MOBILE || MOTE_ROUTER
 /**
 * Sends a MAINT message to the mote in param, including the src addr given in the message
 */
@@ -348,25 +707,23 @@ void send_MAINT(linkaddr_t src_addr, linkaddr_t dest, mote_t *mote){
 	MAINT_message_t* message = (MAINT_message_t*) malloc(MAINT_size);
 	message->type = MAINT;
 	message->src_addr = src_addr;
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = MAINT_size;
-
+	tx_enqueue(TX_CLASS_COMMAND, message, MAINT_size, &dest);
 	free(message);
-
-	NETSTACK_NETWORK.output(&dest);
 }
+#endif
 
+#if MOTE_ROUTER
 /**
 * Forwards a MAINT message to the to the light bulb or the path of the light bulb.
 * If the light bulb is not known locally, it is sent to the parent mote.
 */
 
 void forward_MAINT(linkaddr_t src_addr, mote_t *mote){
-	hashmap_element* map = mote->routing_table->data;
 	int i;
 	int cpt = 0;
 	linkaddr_t dst;
-	for (i = 0; i < mote->routing_table->table_size; i++) {
+	for (i = 0; mote->routing_table != NULL && i < mote->routing_table->table_size; i++) {
+		hashmap_element* map = mote->routing_table->data;
 		hashmap_element elem = *(map+i);
 		if (elem.in_use && elem.typeMote == 2) {
 			dst = elem.data;
@@ -380,7 +737,9 @@ void forward_MAINT(linkaddr_t src_addr, mote_t *mote){
 		send_MAINT(src_addr, dst, mote);	
 	}
 }
+#endif
 
+#if MOTE_SENSOR
 /**
 * Send a MAINACK message to the dest addr given. If the dest mote (the mobile terminal) is not known locally, it is sent to the parent of the mote
 */
@@ -389,44 +748,63 @@ void send_MAINTACK(mote_t *mote, linkaddr_t dst_addr){
 	message->type = MAINTACK;
 	message->dst_addr = dst_addr;
 	
-	linkaddr_t nexthop;
+	linkaddr_t nexthop = mote->parent->addr;
+#if MOTE_ROUTER
 	uint8_t typeMote;
-	if(hashmap_get(mote->routing_table, dst_addr, &typeMote, &nexthop) != MAP_OK){
+	if(mote->routing_table == NULL || hashmap_get(mote->routing_table, dst_addr, &typeMote, &nexthop) != MAP_OK){
 		nexthop = mote->parent->addr;
 	}
+#endif
 	
 	
-	nullnet_buf = (uint8_t*) message;
-	nullnet_len = MAINTACK_size;
-
+	tx_enqueue(TX_CLASS_COMMAND, message, MAINTACK_size, &nexthop);
 	free(message);
-
-	NETSTACK_NETWORK.output(&nexthop);
 }
+#endif
+#if MOTE_ROUTER
 /**
 * Forwards a MAINACK message to the dest addr given in the message. If the dest mote (the mobile terminal) is not known locally, it is sent to the parent of the mote
 */
 void forward_MAINTACK(MAINTACK_message_t *message, mote_t *mote){
 	linkaddr_t nexthop;
 	uint8_t typeMote;
-	if(hashmap_get(mote->routing_table, message->dst_addr, &typeMote, &nexthop) != MAP_OK){
+	if(mote->routing_table == NULL || hashmap_get(mote->routing_table, message->dst_addr, &typeMote, &nexthop) != MAP_OK){
 		nexthop = mote->parent->addr;
 	}
-	nullnet_buf = (uint8_t*) message;	
-	nullnet_len = MAINTACK_size;
-	NETSTACK_NETWORK.output(&nexthop);
+	tx_enqueue(TX_CLASS_COMMAND, message, MAINTACK_size, &nexthop);
 	
 }
+#endif
+
+#if TURNON_MPL
+/**
+* Broadcasts a MPL message. Used by the multicast to (re)transmit a command to all the neighbours
+*/
+void send_MPL(MPL_message_t *message) {
+	tx_enqueue(TX_CLASS_COMMAND, message, MPL_size, NULL);
+}
+#endif
+
+#if ENERGY_REPORTS && MOTE_NODE
+/**
+* Sends or forwards an ENERGY message to the parent of the mote
+*/
+void send_ENERGY(ENERGY_message_t *message, mote_t *mote) {
+	tx_enqueue(TX_CLASS_DATA, message, ENERGY_size, &(mote->parent->addr));
+}
+#endif
 
+#if MOTE_ROUTER
 /**
 * Checks if an addr is already in a table of addresses. Used in the multicast to send only one message per next hop instead of sending one message per final destination
 */
 unsigned isInArray(linkaddr_t* dst, unsigned effectiveSize, linkaddr_t* val){
 	unsigned i = 0;
-	for (i = 0; i <= effectiveSize; i++){
+	for (i = 0; i < effectiveSize; i++){
 		if (dst[i].u16[0] == val->u16[0]){
 			return 1;
 		}
 	}
 	return 0;
 }
+#endif
@@ -2,6 +2,9 @@
  * Defines data and functions useful for the routing protocol of the motes, based on RPL.
  */
 
+#ifndef ROUTING_H_
+#define ROUTING_H_
+
 #include "contiki.h"
 #include "net/netstack.h"
 #include "net/nullnet/nullnet.h"
@@ -14,6 +17,7 @@
 #include "random.h"
 
 #include "hashmap.h"
+#include "role-config.h"
 
 
 ///////////////////
@@ -46,29 +50,105 @@
 
 #define TIMEOUT_WATER 180
 
+// Signal strength above which a single transmission is expected to reach a neighbour (in dBm)
+#define RSS_GOOD_LINK -80
+
+// Costs used by forward_TURNON to choose between unicasts and a broadcast, in quarters of a frame
+#define COST_FRAME       4	// one transmission
+#define COST_WEAK_FRAME  8	// expected transmissions on a link below RSS_GOOD_LINK
+#define COST_DROP        1	// a non-target neighbour waking up to drop a broadcast
+
+// Period of the check of the congestion of the mote and of its path to the root. The check
+// may be delayed by a whole period, to share the wakeup of another timer
+#define CONGESTION_CHECK (CLOCK_SECOND*5)
+
+// Largest factor applied to the reporting period of the sensors while their path is congested
+#define REPORT_SCALE_MAX 8
+
+// Number of TURNON commands remembered to drop the duplicates
+#define RECENT_CMDS 4
+// Time during which a TURNON command already handled is dropped: long enough for the repairs of a
+// broadcast, shorter than a reboot of the root, which starts its command IDs again from 1
+#define RECENT_CMDS_LIFETIME (CLOCK_SECOND*10)
+
+// Largest number of neighbours considered by forward_TURNON: past it, the command is broadcast
+#define TURNON_NEIGHBOURS 16
+
+// Size of the bitmaps of acknowledged motes. Bit i stands for the mote with address i (modulo 64)
+#define ACK_BITMAP_BYTES 8
+#define ACK_BITMAP_BITS (ACK_BITMAP_BYTES*8)
+
+// Maximum number of hops recorded in the trace of a command
+#define TRACE_MAX_HOPS 6
+
+// Unit of the delays recorded in the trace of a command [ms]
+#define TRACE_DELAY_UNIT 8
+
+// 1 to stamp the hop count and the time spent in the forwarders on the upward messages
+#ifndef PATH_TELEMETRY
+#define PATH_TELEMETRY 1
+#endif
+
+// 1 to flood TURNON commands with the MPL-style multicast (see mpl.h), 0 to use forward_TURNON
+#ifndef TURNON_MPL
+#define TURNON_MPL 0
+#endif
 
+// 1 when the motes are built with TSCH (MAC=tsch), with the schedule of dodag-schedule.h
+#ifndef MOTE_TSCH
+#define MOTE_TSCH 0
+#endif
 
+// 1 to measure the energy spent by the motes and report it to the root (see energy.h)
+#ifndef ENERGY_REPORTS
+#define ENERGY_REPORTS 1
+#endif
+
+// Number of message classes in the energy reports (see energy.h)
+#define ENERGY_CLASSES 6
+
+
+
+// Values for the different types of messages, as constant expressions for the handler tables
+#define MSG_DIS      2
+#define MSG_DIO      3
+#define MSG_DAO      4
+#define MSG_TURNON   5
+#define MSG_ACK      6
+#define MSG_LIGHT    7
+#define MSG_MAINT    8
+#define MSG_MAINTACK 9
+#define MSG_MPL      10
+#define MSG_ACKAGG   11
+#define MSG_ENERGY   12
+#define MSG_TYPES    13
 
 // Values for the different types of messages
-const uint8_t DIS;
-const uint8_t DIO;
-const uint8_t DAO;
-const uint8_t LIGHT;
-const uint8_t TURNON;
-const uint8_t ACK;
-const uint8_t MAINT;
-const uint8_t MAINTACK;
+extern const uint8_t DIS;
+extern const uint8_t DIO;
+extern const uint8_t DAO;
+extern const uint8_t LIGHT;
+extern const uint8_t TURNON;
+extern const uint8_t ACK;
+extern const uint8_t MAINT;
+extern const uint8_t MAINTACK;
+extern const uint8_t MPL;
+extern const uint8_t ACKAGG;
+extern const uint8_t ENERGY;
 
 
 // Size of control messages
-const size_t DIS_size;
-const size_t DIO_size;
-const size_t DAO_size;
-const size_t LIGHT_size;
-const size_t TURNON_size;
-const size_t ACK_size;
-const size_t MAINT_size;
-const size_t MAINTACK_size;
+extern const size_t DIS_size;
+extern const size_t DIO_size;
+extern const size_t DAO_size;
+extern const size_t LIGHT_size;
+extern const size_t TURNON_size;
+extern const size_t ACK_size;
+extern const size_t MAINT_size;
+extern const size_t MAINTACK_size;
+extern const size_t MPL_size;
+extern const size_t ACKAGG_size;
+extern const size_t ENERGY_size;
 
 
 
@@ -84,6 +164,7 @@ typedef struct parent_mote {
 	uint8_t rank;
 	signed char rss;
 	uint8_t typeMote;
+	uint8_t congested;	// 1 if the parent or one of its ancestors is congested
 } parent_t;
 
 // Represents the attributes of a mote
@@ -94,9 +175,33 @@ typedef struct mote {
 	parent_t* parent;
 	hashmap_map* routing_table;
 	uint8_t typeMote;
+	uint8_t recent_cmds[RECENT_CMDS];	// Last TURNON commands received
+	clock_time_t recent_cmds_time[RECENT_CMDS];	// and the time they were received
+	uint8_t recent_cmds_next;
+	uint8_t congested;	// 1 if the mote or one of its ancestors is congested, advertised in the DIOs
+	uint8_t report_scale;	// factor applied to the reporting period of a sensor
+	uint8_t leaf;		// 1 in leaf mode: no DIOs and no routing table (NULL) until a DAO arrives
 } mote_t;
 
 
+// Represents the record of a hop of a command: the mote and the time the command spent in it
+typedef struct trace_hop {
+	uint8_t node;		// low byte of the address of the mote
+	uint8_t delay;		// in units of TRACE_DELAY_UNIT, saturates at 255
+} trace_hop_t;
+
+// Represents the trace of a command on its way from the root to an actuator
+typedef struct trace {
+	uint8_t hops;		// motes that received the command, can be larger than TRACE_MAX_HOPS
+	trace_hop_t hop[TRACE_MAX_HOPS];
+} trace_t;
+
+// Represents the trailer of the upward messages (DAO, LIGHT, ACK), stamped by each forwarder
+typedef struct path_trailer {
+	uint8_t hops;		// number of forwarders
+	uint16_t residence;	// time spent in the forwarders [ms], saturates at 65535
+} path_trailer_t;
+
 // Represents a DIS control message
 typedef struct DIS_message {
 	uint8_t type;
@@ -107,6 +212,7 @@ typedef struct DIO_message {
 	uint8_t type;
 	uint8_t rank;
 	uint8_t typeMote;
+	uint8_t congested;
 } DIO_message_t;
 
 // Represents a DAO control message
@@ -114,24 +220,54 @@ typedef struct DAO_message {
 	uint8_t type;
 	linkaddr_t src_addr;
 	uint8_t typeMote;
+#if PATH_TELEMETRY
+	path_trailer_t path;
+#endif
 } DAO_message_t;
 
-// Represents a LIGHT message with the light level
+// Represents a LIGHT message with the light level and the sensor that measured it
 typedef struct LIGHT_message {
 	uint8_t type;
 	uint16_t light_level;
+	linkaddr_t src_addr;
+#if PATH_TELEMETRY
+	path_trailer_t path;
+#endif
 } LIGHT_message_t;
 
 // Represents a TURNON message with the mote type. It can be either sprinklers or light bulbs
+// The command ID, chosen by the root, lets the motes drop the copies of a command they already handled
+// Only the actuators of the targets act on it, and only their next hops get it
 typedef struct TURNON_message {
 	uint8_t type;
 	uint8_t typeMote;
+	uint8_t cmd_id;
+	uint8_t targets[ACK_BITMAP_BYTES];	// bitmap of the actuators to turn on, as the ACK bitmaps
+	trace_t trace;
 } TURNON_message_t;
-// Represents an ACK message sent by a mote turned on
+// Represents an ACK message sent by a mote turned on, with the command it acknowledges
+// and the trace of the command on its way to the mote
 typedef struct ACK_message {
 	uint8_t type;
 	uint8_t typeMote;
+	uint8_t cmd_id;
+	linkaddr_t src_addr;
+	trace_t trace;
+#if PATH_TELEMETRY
+	path_trailer_t path;
+#endif
 } ACK_message_t;
+
+// Represents several ACK messages for the same command, merged by a sub gateway
+typedef struct ACKAGG_message {
+	uint8_t type;
+	uint8_t typeMote;
+	uint8_t cmd_id;
+	uint8_t count;
+	uint8_t bitmap[ACK_BITMAP_BYTES];	// motes that acknowledged the command
+	linkaddr_t trace_src;			// mote of the slowest trace among the merged ACKs
+	trace_t trace;
+} ACKAGG_message_t;
 // Represents a maintenance message sent by te mobile terminal
 typedef struct MAINT_message {
 	uint8_t type;
@@ -144,6 +280,31 @@ typedef struct MAINTACK_message {
 	linkaddr_t dst_addr;
 } MAINTACK_message_t;
 
+// Represents a TURNON command flooded with the MPL-style multicast.
+// The seed (originator) and the sequence number identify the command in the duplicate cache
+typedef struct MPL_message {
+	uint8_t type;
+	linkaddr_t seed;
+	uint8_t seq;
+	uint8_t typeMote;
+} MPL_message_t;
+
+// Represents the energy spent by a mote over a period, reported to the root
+typedef struct ENERGY_message {
+	uint8_t type;
+	linkaddr_t src_addr;
+	uint16_t period;	// [sec]
+	uint16_t cpu;		// time spent in each state over the period [ENERGY_UNIT ms]
+	uint16_t lpm;
+	uint16_t listen;
+	uint16_t transmit;
+	uint16_t tx[ENERGY_CLASSES];	// transmit time of each message class [ms]
+	uint16_t rx[ENERGY_CLASSES];	// estimated receive time of each message class [ms]
+	uint8_t readings;	// LIGHT messages sent over the period
+	uint16_t drops;		// frames dropped by the transmit and receive queues since the boot
+	uint8_t routes;		// entries of the routing table
+} ENERGY_message_t;
+
 ///////////////////
 ///  FUNCTIONS  ///
 ///////////////////
@@ -153,6 +314,41 @@ typedef struct MAINTACK_message {
  */
 void init_mote(mote_t *mote, uint8_t type);
 
+/**
+ * Returns the signal strength of the frame being processed (in dBm).
+ */
+signed char link_rss();
+
+/**
+ * Starts watching the congestion of a mote. A router advertises the changes to its children.
+ */
+void congestion_init(mote_t *mote, uint8_t advertise);
+
+/**
+ * Returns the reporting period of a sensor, scaled up while its path to the root is
+ * congested: the factor doubles at each report sent during a congestion, and goes back
+ * down by one at each report sent once the congestion has cleared.
+ */
+clock_time_t report_interval(mote_t *mote, clock_time_t period);
+
+/**
+ * Adds the time a frame waited in the transmit queue to the residence time of its
+ * trailer, or to the delay of this mote in its trace. Called when the frame leaves the queue.
+ */
+void stamp_queue_delay(uint8_t *frame, uint16_t len, clock_time_t waited);
+
+#if PATH_TELEMETRY
+/**
+ * Initializes the trailer of an upward message sent by this mote.
+ */
+void path_init(path_trailer_t *path);
+
+/**
+ * Adds this mote, and the time the message spent in it since it was received, to the trailer of an upward message.
+ */
+void path_stamp(path_trailer_t *path, clock_time_t received);
+#endif
+
 /**
  * Initializes the attributes of a root mote.
  */
@@ -217,14 +413,35 @@ void send_LIGHT(mote_t *mote);
 void forward_LIGHT(LIGHT_message_t *message, mote_t *mote);
 
 /**
-* Sends a TURNON message to the mote in param, including the typeMote given in param
+* Sends a TURNON message to the mote in param
+*/
+void send_TURNON(TURNON_message_t *message, linkaddr_t dest);
+
+/**
+* Broadcasts a TURNON message. Only the children of this mote act on it
+*/
+void broadcast_TURNON(TURNON_message_t *message);
+
+/**
+* Creates a new TURNON command for the actuators of the given typeMote in the targets bitmap,
+* and forwards it. Used by the root.
+* Returns the command ID.
+*/
+uint8_t originate_TURNON(uint8_t typeMote, const uint8_t *targets, mote_t *mote);
+
+/**
+* forward TURNON message to all the target motes of the given typeMote known locally.
+* Chooses between one unicast per next hop and a single broadcast, depending on the fan-out,
+* the quality of the links and the number of neighbours that would have to drop the broadcast.
 */
-void send_TURNON(uint8_t typeMote, linkaddr_t dest, mote_t *mote);
+void forward_TURNON(TURNON_message_t *message, mote_t *mote);
 
 /**
-* forward TURNON message to all the motes of the given typeMote known locally
+* Returns 1 if a received TURNON message must be handled, 0 if it must be dropped.
+* A broadcast TURNON is only for the children of the sender, and the copies of a command
+* already handled (broadcast followed by a repair) are dropped.
 */
-void forward_TURNON(uint8_t typeMote, mote_t *mote);
+uint8_t accept_TURNON(TURNON_message_t *message, const linkaddr_t *from, uint8_t broadcast, mote_t *mote);
 
 /**
 * Checks if an addr is already in a table of addresses. Used in the multicast to send only one message per next hop instead of sending one message per final destination
@@ -232,14 +449,45 @@ void forward_TURNON(uint8_t typeMote, mote_t *mote);
 unsigned isInArray(linkaddr_t* dst, unsigned effectiveSize, linkaddr_t *val);
 
 /**
-* Sends an ACK message to the parent of the mote
+* Sends an ACK message for the given command to the parent of the mote.
+* The trace of the command is returned with the ACK, if there is one (NULL otherwise).
+*/
+void send_ACK(mote_t *mote, uint8_t cmd_id, trace_t *trace);
+
+/**
+* forwards an ACK message to the parent of the mote, received at the given time
+*/
+void forward_ACK(ACK_message_t *message, clock_time_t received, mote_t *mote);
+
+/**
+* Sends or forwards an ACKAGG message to the parent of the mote
+*/
+void forward_ACKAGG(ACKAGG_message_t *message, mote_t *mote);
+
+/**
+* Adds the record of this mote to the trace of a command it has just received
+*/
+void trace_hop(trace_t *trace, mote_t *mote);
+
+/**
+* Updates the delay of the last record of a trace, just before the command leaves the mote
+*/
+void trace_stamp(trace_t *trace);
+
+/**
+* Returns the sum of the delays recorded in a trace [ms]
 */
-void send_ACK(mote_t *mote);
+unsigned long trace_delay(trace_t *trace);
 
 /**
-* forwards an ACK message to the parent of the mote
+* Sets the bit of the given address in a bitmap of acknowledged motes
 */
-void forward_ACK(ACK_message_t *message, mote_t *mote);
+void ack_bitmap_set(uint8_t *bitmap, const linkaddr_t *addr);
+
+/**
+* Returns 1 if the bit i is set in a bitmap of motes (acknowledged or targets), 0 otherwise
+*/
+uint8_t ack_bitmap_test(const uint8_t *bitmap, unsigned i);
 
 /**
 * Sends a MAINT message to the mote in param, including the src addr given in the message
@@ -261,3 +509,15 @@ void send_MAINTACK(mote_t *mote, linkaddr_t dst_addr);
 * Forwards a MAINACK message to the dest addr given in the message. If the dest mote (the mobile terminal) is not known locally, it is sent to the parent of the mote
 */
 void forward_MAINTACK(MAINTACK_message_t *message, mote_t *mote);
+
+/**
+* Broadcasts a MPL message. Used by the multicast to (re)transmit a command to all the neighbours
+*/
+void send_MPL(MPL_message_t *message);
+
+/**
+* Sends or forwards an ENERGY message to the parent of the mote
+*/
+void send_ENERGY(ENERGY_message_t *message, mote_t *mote);
+
+#endif /* ROUTING_H_ */
@@ -0,0 +1,133 @@
+/**
+ * Receive queue of the motes.
+ */
+
+#include "rx-queue.h"
+#include "energy.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Represents a frame waiting to be processed
+typedef struct rx_event {
+	uint8_t data[sizeof(any_message_t)];
+	uint8_t len;
+	signed char rss;
+	linkaddr_t src;
+	linkaddr_t dest;
+	clock_time_t received;
+} rx_event_t;
+
+// Circular queue of the received frames
+static rx_event_t events[RX_DEPTH];
+static uint8_t head = 0;	// index of the oldest frame
+static uint8_t length = 0;
+static uint16_t drops = 0;
+
+// Frame being processed
+static rx_event_t *current = NULL;
+
+// Function of the mote handling the frames
+static rx_handler_t rx_handler = NULL;
+
+PROCESS(rx_process, "Receive queue");
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Callback function, called by NullNet when a frame is received.
+ * Copies the frame in the queue, the packetbuf is reused by the next frame.
+ */
+static void rx_input(const void *data, uint16_t len,
+	const linkaddr_t *src, const linkaddr_t *dest)
+{
+	if (len > sizeof(any_message_t)) {
+		LOG_INFO("Frame of %u bytes too long for the receive queue\n", len);
+		return;
+	}
+	energy_rx(data, len);
+	if (length == RX_DEPTH) {
+		drops++;
+		LOG_INFO("Receive queue full, frame dropped (%u drops)\n", drops);
+		return;
+	}
+
+	rx_event_t *event = &events[(head + length) % RX_DEPTH];
+	memcpy(event->data, data, len);
+	event->len = len;
+	event->rss = (signed char) packetbuf_attr(PACKETBUF_ATTR_RSSI);
+	linkaddr_copy(&(event->src), src);
+	linkaddr_copy(&(event->dest), dest);
+	event->received = clock_time();
+	length++;
+
+	process_poll(&rx_process);
+}
+
+/**
+ * Sets the input callback of NullNet, and starts the process that hands the received
+ * frames to the given function.
+ */
+void rx_init(rx_handler_t handler) {
+	rx_handler = handler;
+	nullnet_set_input_callback(rx_input);
+	if (!process_is_running(&rx_process)) {
+		process_start(&rx_process, NULL);
+	}
+}
+
+/**
+ * Returns the signal strength of the frame being processed (in dBm).
+ */
+signed char rx_rss() {
+	return current != NULL ? current->rss : 0;
+}
+
+/**
+ * Returns the time at which the frame being processed was received.
+ */
+clock_time_t rx_received() {
+	return current != NULL ? current->received : clock_time();
+}
+
+/**
+ * Returns the number of frames dropped because the queue was full.
+ */
+uint16_t rx_drops() {
+	return drops;
+}
+
+PROCESS_THREAD(rx_process, ev, data) {
+	PROCESS_BEGIN();
+
+	while(1) {
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+		uint8_t batch;
+		for (batch = 0; batch < RX_BATCH && length > 0; batch++) {
+			// The frame stays in its slot while it is handled: frames received meanwhile go after it
+			current = &events[head];
+			rx_handler(current->data, current->len, &(current->src), &(current->dest));
+			current = NULL;
+			head = (head + 1) % RX_DEPTH;
+			length--;
+		}
+
+		// Let the other processes run before the rest of a burst
+		if (length > 0) {
+			process_poll(&rx_process);
+		}
+	}
+
+	PROCESS_END();
+}
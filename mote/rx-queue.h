@@ -0,0 +1,63 @@
+/**
+ * Receive queue of the motes.
+ *
+ * The input callback of NullNet only copies the frame in the queue, with its signal strength
+ * and the time it was received, and polls a process. The process hands the frames to the
+ * input callback of the mote in batches, out of the input path of the radio, so a burst of
+ * frames isn't lost while the previous ones update the routing table or are forwarded.
+ */
+
+#ifndef RX_QUEUE_H_
+#define RX_QUEUE_H_
+
+#include "tx-queue.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Maximum number of frames waiting to be processed
+#define RX_DEPTH 4
+
+// Maximum number of frames processed before letting the other processes run
+#define RX_BATCH 4
+
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Function called by the process for each received frame
+typedef void (*rx_handler_t)(const void *data, uint16_t len,
+	const linkaddr_t *src, const linkaddr_t *dest);
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Sets the input callback of NullNet, and starts the process that hands the received
+ * frames to the given function.
+ */
+void rx_init(rx_handler_t handler);
+
+/**
+ * Returns the signal strength of the frame being processed (in dBm).
+ */
+signed char rx_rss();
+
+/**
+ * Returns the time at which the frame being processed was received.
+ */
+clock_time_t rx_received();
+
+/**
+ * Returns the number of frames dropped because the queue was full.
+ */
+uint16_t rx_drops();
+
+#endif /* RX_QUEUE_H_ */
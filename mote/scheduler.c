@@ -0,0 +1,132 @@
+/**
+ * Timer scheduler of the motes, coalescing the wakeups.
+ */
+
+#include "scheduler.h"
+
+
+// Timers known by the scheduler, active or not
+static sched_timer_t *timers = NULL;
+
+// Callback timer of the next wakeup
+static struct ctimer wakeup_timer;
+
+// 1 while the expired timers are handled, the next wakeup is computed at the end
+static uint8_t expiring = 0;
+
+// Counters since the last call to sched_wakeups
+static uint16_t wakeups = 0;
+static uint16_t expirations = 0;
+
+/**
+ * Returns the number of ticks before the deadline of a timer, 0 if it has passed.
+ */
+static clock_time_t remaining(sched_timer_t *timer, clock_time_t now) {
+	clock_time_t elapsed = now - timer->start;
+	return elapsed >= timer->interval ? 0 : timer->interval - elapsed;
+}
+
+static void wakeup_callback(void *ptr);
+
+/**
+ * Sets the next wakeup at the latest time allowed by the active timers.
+ */
+static void schedule() {
+	if (expiring) {
+		return;
+	}
+	clock_time_t now = clock_time();
+	uint8_t any = 0;
+	clock_time_t next = 0;
+	sched_timer_t *timer;
+	for (timer = timers; timer != NULL; timer = timer->next) {
+		if (timer->active) {
+			clock_time_t latest = remaining(timer, now) + timer->slack;
+			if (!any || latest < next) {
+				next = latest;
+				any = 1;
+			}
+		}
+	}
+	if (any) {
+		ctimer_set(&wakeup_timer, next, wakeup_callback, NULL);
+	} else {
+		ctimer_stop(&wakeup_timer);
+	}
+}
+
+/**
+ * Callback function of the wakeups: expires every timer whose deadline has passed.
+ * The callbacks can set or stop any timer, so the list is scanned again after each of them.
+ */
+static void wakeup_callback(void *ptr) {
+	wakeups++;
+	expiring = 1;
+	uint8_t expired = 1;
+	while (expired) {
+		expired = 0;
+		clock_time_t now = clock_time();
+		sched_timer_t *timer;
+		for (timer = timers; timer != NULL; timer = timer->next) {
+			if (timer->active && remaining(timer, now) == 0) {
+				timer->active = 0;
+				expirations++;
+				timer->callback(timer->ptr);
+				expired = 1;
+				break;
+			}
+		}
+	}
+	expiring = 0;
+	schedule();
+}
+
+/**
+ * Starts a timer that expires between interval and interval + slack ticks from now.
+ */
+void sched_set(sched_timer_t *timer, clock_time_t interval, clock_time_t slack,
+	sched_callback_t callback, void *ptr)
+{
+	sched_timer_t *known;
+	for (known = timers; known != NULL && known != timer; known = known->next);
+	if (known == NULL) {
+		timer->next = timers;
+		timers = timer;
+	}
+	timer->start = clock_time();
+	timer->interval = interval;
+	timer->slack = slack;
+	timer->callback = callback;
+	timer->ptr = ptr;
+	timer->active = 1;
+	schedule();
+}
+
+/**
+ * Restarts an expired timer with the same interval, from its previous deadline (no drift).
+ */
+void sched_reset(sched_timer_t *timer) {
+	timer->start += timer->interval;
+	timer->active = 1;
+	schedule();
+}
+
+/**
+ * Stops a timer.
+ */
+void sched_stop(sched_timer_t *timer) {
+	timer->active = 0;
+	schedule();
+}
+
+/**
+ * Returns the number of wakeups of the scheduler since the last call, and the number of
+ * timers they expired in expirations.
+ */
+uint16_t sched_wakeups(uint16_t *expired) {
+	uint16_t count = wakeups;
+	*expired = expirations;
+	wakeups = 0;
+	expirations = 0;
+	return count;
+}
@@ -0,0 +1,63 @@
+/**
+ * Timer scheduler of the motes, coalescing the wakeups.
+ *
+ * Each timer has a deadline and a slack: it may expire up to slack ticks after its deadline.
+ * The scheduler only wakes up at the latest time allowed by the most urgent timer, and
+ * expires then every timer whose deadline has passed. The periodic DIO, DAO, parent,
+ * children and application timers therefore share their wakeups, and their transmissions
+ * leave in the same burst.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "contiki.h"
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Function called when a timer expires
+typedef void (*sched_callback_t)(void *ptr);
+
+// Represents a timer of the scheduler
+typedef struct sched_timer {
+	struct sched_timer *next;	// list of the timers known by the scheduler
+	clock_time_t start;
+	clock_time_t interval;
+	clock_time_t slack;
+	sched_callback_t callback;
+	void *ptr;
+	uint8_t active;
+} sched_timer_t;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Starts a timer that expires between interval and interval + slack ticks from now.
+ */
+void sched_set(sched_timer_t *timer, clock_time_t interval, clock_time_t slack,
+	sched_callback_t callback, void *ptr);
+
+/**
+ * Restarts an expired timer with the same interval, from its previous deadline (no drift).
+ */
+void sched_reset(sched_timer_t *timer);
+
+/**
+ * Stops a timer.
+ */
+void sched_stop(sched_timer_t *timer);
+
+/**
+ * Returns the number of wakeups of the scheduler since the last call, and the number of
+ * timers they expired in expirations.
+ */
+uint16_t sched_wakeups(uint16_t *expirations);
+
+#endif /* SCHEDULER_H_ */
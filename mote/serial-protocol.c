@@ -0,0 +1,325 @@
+/**
+ * Binary protocol between the root and the server, on the serial line.
+ */
+
+#include "serial-protocol.h"
+#include "scheduler.h"
+#include "dev/uart0.h"
+#include "lib/crc16.h"
+#include <stdio.h>
+#include <string.h>
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Bytes per second of the UART the frames may use
+#define UPLINK_BYTE_RATE ((uint32_t) UPLINK_BAUD / 10 * UPLINK_SHARE / 100)
+
+
+
+///////////////////
+///  VARIABLES  ///
+///////////////////
+
+// Record being written
+static uint8_t record[SERIAL_FRAME_MAX];
+static uint8_t record_len = 0;
+
+// Uplink buffer: records waiting to be sent, oldest first, from uplink_start
+static uint8_t uplink[UPLINK_BUFFER];
+static uint16_t uplink_start = 0;
+static uint16_t uplink_len = 0;
+
+// Bytes the frames may still write on the UART, and time it was last refilled
+static int32_t credit = UPLINK_BUFFER;
+static clock_time_t credit_time = 0;
+
+// Timer of the flush of the records waiting, and of the REC_UPLINK reports
+static sched_timer_t flush_timer;
+static sched_timer_t uplink_timer;
+
+// Use of the UART since the last REC_UPLINK report
+static uint32_t uplink_bytes = 0;
+static uint16_t uplink_frames = 0;
+static uint16_t uplink_records = 0;
+static uint16_t uplink_dropped = 0;
+static uint16_t uplink_peak = 0;
+
+// Frame being received by the interrupt of the UART
+static uint8_t rx_buf[SERIAL_INPUT_MAX];
+static uint8_t rx_len = 0;
+static uint8_t rx_esc = 0;
+static uint8_t rx_overflow = 0;
+
+// Frames received, waiting for serial_input: the interrupt adds them at input_head, serial_input
+// takes them from input_tail. Each index is only written by one side, and wraps at 256
+static uint8_t input[SERIAL_INPUT_FRAMES][SERIAL_INPUT_MAX];
+static uint8_t input_len[SERIAL_INPUT_FRAMES];
+static volatile uint8_t input_head = 0;
+static volatile uint8_t input_tail = 0;
+
+// Frames received while the ring was full, since the boot, and at the last REC_UPLINK report
+static volatile uint16_t input_dropped = 0;
+static uint16_t input_dropped_reported = 0;
+
+// Process polled when a frame is received
+static struct process *input_process = NULL;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Input callback of the UART, called by its interrupt for each byte received.
+ */
+static int serial_input_byte(unsigned char c) {
+	if (c == SERIAL_END) {
+		// A frame too long is dropped, and so is a frame received while the ring is full
+		if (rx_len > 0 && !rx_overflow) {
+			if ((uint8_t) (input_head - input_tail) < SERIAL_INPUT_FRAMES) {
+				memcpy(input[input_head % SERIAL_INPUT_FRAMES], rx_buf, rx_len);
+				input_len[input_head % SERIAL_INPUT_FRAMES] = rx_len;
+				input_head++;
+				process_poll(input_process);
+			} else {
+				input_dropped++;
+			}
+		}
+		rx_len = 0;
+		rx_esc = 0;
+		rx_overflow = 0;
+		return 1;
+	}
+	if (c == SERIAL_ESC) {
+		rx_esc = 1;
+		return 1;
+	}
+	if (rx_esc) {
+		c = c == SERIAL_ESC_END ? SERIAL_END : c == SERIAL_ESC_ESC ? SERIAL_ESC : c;
+		rx_esc = 0;
+	}
+	if (rx_len < SERIAL_INPUT_MAX) {
+		rx_buf[rx_len++] = c;
+	} else {
+		rx_overflow = 1;
+	}
+	return 1;
+}
+
+/**
+ * Callback function that reports the use of the UART since the last report in a REC_UPLINK record.
+ */
+static void uplink_callback(void *ptr) {
+	uint32_t utilization = uplink_bytes * 10 / (UPLINK_BAUD / 1000 * UPLINK_REPORT);
+	serial_begin(REC_UPLINK);
+	serial_u16(UPLINK_REPORT);
+	serial_u32(uplink_bytes);
+	serial_u16(uplink_frames);
+	serial_u16(uplink_records);
+	serial_u16(uplink_dropped);
+	serial_u16(uplink_peak);
+	serial_u16(utilization);
+	serial_u16(input_dropped - input_dropped_reported);
+	input_dropped_reported = input_dropped;
+	uplink_bytes = 0;
+	uplink_frames = 0;
+	uplink_records = 0;
+	uplink_dropped = 0;
+	uplink_peak = uplink_len;
+	serial_end();
+	sched_reset(&uplink_timer);
+}
+
+/**
+ * Sets the input of the serial line, and starts the REC_UPLINK reports. The given process is
+ * polled when a frame is received.
+ */
+void serial_init(struct process *process) {
+	input_process = process;
+	uart0_set_input(serial_input_byte);
+	credit_time = clock_time();
+	sched_set(&uplink_timer, CLOCK_SECOND*UPLINK_REPORT, CLOCK_SECOND*UPLINK_REPORT/10,
+		uplink_callback, NULL);
+}
+
+/**
+ * Checks the frames received, if any, and hands each of their records to the handler.
+ * Called by the process given to serial_init when it is polled.
+ */
+void serial_input(serial_handler_t handler) {
+	while (input_tail != input_head) {
+		const uint8_t *frame = input[input_tail % SERIAL_INPUT_FRAMES];
+		uint8_t frame_len = input_len[input_tail % SERIAL_INPUT_FRAMES];
+		if (frame_len > 2) {
+			uint8_t len = frame_len - 2;
+			uint16_t crc = frame[len] | (frame[len+1] << 8);
+			if (crc16_data(frame, len, 0) == crc) {
+				uint8_t i = 0;
+				while (i + 2 <= len && i + 2 + frame[i+1] <= len) {
+					handler(frame[i], &frame[i+2], frame[i+1]);
+					i += 2 + frame[i+1];
+				}
+			}
+		}
+		input_tail++;
+	}
+}
+
+/**
+ * Writes a byte of a frame, escaped, and returns the number of bytes written.
+ */
+static uint8_t write_escaped(uint8_t c) {
+	if (c == SERIAL_END) {
+		putchar(SERIAL_ESC);
+		putchar(SERIAL_ESC_END);
+		return 2;
+	} else if (c == SERIAL_ESC) {
+		putchar(SERIAL_ESC);
+		putchar(SERIAL_ESC_ESC);
+		return 2;
+	}
+	putchar(c);
+	return 1;
+}
+
+/**
+ * Returns the byte at the given offset from the oldest record of the uplink buffer.
+ */
+static uint8_t uplink_byte(uint16_t offset) {
+	return uplink[(uplink_start + offset) % UPLINK_BUFFER];
+}
+
+/**
+ * Removes the oldest record of the uplink buffer.
+ */
+static void uplink_pop() {
+	uint8_t len = 2 + uplink_byte(1);
+	uplink_start = (uplink_start + len) % UPLINK_BUFFER;
+	uplink_len -= len;
+}
+
+/**
+ * Writes a frame on the UART in one burst: the oldest records of the uplink buffer that fit in
+ * it, and their CRC. Returns the number of bytes written.
+ */
+static uint16_t write_frame() {
+	uint8_t i, len;
+	uint8_t frame_len = 0;
+	uint16_t written = 2;
+	uint16_t crc = 0;
+	putchar(SERIAL_END);
+	while (uplink_len > 0 && frame_len + 2 + uplink_byte(1) <= SERIAL_FRAME_MAX) {
+		len = 2 + uplink_byte(1);
+		for (i = 0; i < len; i++) {
+			crc = crc16_add(uplink_byte(i), crc);
+			written += write_escaped(uplink_byte(i));
+		}
+		uplink_pop();
+		frame_len += len;
+		uplink_records++;
+	}
+	written += write_escaped(crc & 0xff);
+	written += write_escaped(crc >> 8);
+	putchar(SERIAL_END);
+	return written;
+}
+
+/**
+ * Adds the bytes the frames may write since the last refill, up to a full buffer.
+ */
+static void credit_refill() {
+	clock_time_t now = clock_time();
+	clock_time_t elapsed = now - credit_time;
+	if (elapsed >= CLOCK_SECOND) {
+		credit = UPLINK_BUFFER;
+	} else {
+		credit += (uint32_t) elapsed * UPLINK_BYTE_RATE / CLOCK_SECOND;
+		if (credit > UPLINK_BUFFER) {
+			credit = UPLINK_BUFFER;
+		}
+	}
+	credit_time = now;
+}
+
+/**
+ * Callback function of the flush timer.
+ */
+static void flush_callback(void *ptr) {
+	serial_flush();
+}
+
+/**
+ * Sends the records waiting in the uplink buffer, as far as the share of the UART allows.
+ */
+void serial_flush() {
+	uint16_t written;
+	credit_refill();
+	while (uplink_len > 0 && credit > 0) {
+		written = write_frame();
+		credit -= written;
+		uplink_bytes += written;
+		uplink_frames++;
+	}
+	if (uplink_len > 0) {
+		sched_set(&flush_timer, UPLINK_FLUSH_TIME, UPLINK_FLUSH_SLACK, flush_callback, NULL);
+	} else {
+		sched_stop(&flush_timer);
+	}
+}
+
+/**
+ * Starts a record of the given type. Its value is written with serial_u8, serial_u16 and
+ * serial_u32, and serial_end queues it. The bytes that don't fit in a frame are dropped.
+ */
+void serial_begin(uint8_t type) {
+	record[0] = type;
+	record_len = 2;
+}
+
+/**
+ * Writes an integer in the value of the current record.
+ */
+void serial_u8(uint8_t value) {
+	if (record_len < SERIAL_FRAME_MAX) {
+		record[record_len++] = value;
+	}
+}
+
+void serial_u16(uint16_t value) {
+	serial_u8(value & 0xff);
+	serial_u8(value >> 8);
+}
+
+void serial_u32(uint32_t value) {
+	serial_u16(value & 0xffff);
+	serial_u16(value >> 16);
+}
+
+/**
+ * Ends the current record, and queues it in the uplink buffer.
+ */
+void serial_end() {
+	uint8_t i;
+	record[1] = record_len - 2;
+	// The server link is too slow: the oldest records make room for the new one
+	while (UPLINK_BUFFER - uplink_len < record_len) {
+		uplink_pop();
+		uplink_dropped++;
+	}
+	for (i = 0; i < record_len; i++) {
+		uplink[(uplink_start + uplink_len + i) % UPLINK_BUFFER] = record[i];
+	}
+	uplink_len += record_len;
+	if (uplink_len > uplink_peak) {
+		uplink_peak = uplink_len;
+	}
+	if (uplink_len >= UPLINK_FLUSH_SIZE) {
+		serial_flush();
+	} else if (!flush_timer.active) {
+		sched_set(&flush_timer, UPLINK_FLUSH_TIME, UPLINK_FLUSH_SLACK, flush_callback, NULL);
+	}
+}
@@ -0,0 +1,136 @@
+/**
+ * Binary protocol between the root and the server, on the serial line.
+ *
+ * A frame is a sequence of TLV records (type, length, value) followed by the CRC-16 of the
+ * records (lib/crc16 of Contiki), delimited by SLIP END bytes, with END and ESC escaped inside.
+ * The integers are little endian. The logs of the root are still printed as text lines
+ * between the frames: an END starts a frame, the next END ends it.
+ * serial_protocol.py implements the same protocol for the server.
+ *
+ * The records are not written on the UART one by one: they wait in the uplink buffer, and are
+ * sent together in one frame when UPLINK_FLUSH_SIZE bytes are waiting or UPLINK_FLUSH_TIME
+ * after the first one, so the root blocks on the UART in a few bursts. The frames may use at
+ * most UPLINK_SHARE percent of the UART: beyond that, the records wait in the buffer, and
+ * when it is full the oldest ones are dropped. A REC_UPLINK record reports every UPLINK_REPORT
+ * seconds the use of the UART and the records dropped. The text logs are not counted.
+ * The frames of the server are kept in a ring of SERIAL_INPUT_FRAMES until the process reads
+ * them; those received while it is full are dropped, and counted in the REC_UPLINK records.
+ */
+
+#ifndef SERIAL_PROTOCOL_H_
+#define SERIAL_PROTOCOL_H_
+
+#include "contiki.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// SLIP bytes
+#define SERIAL_END     0xC0
+#define SERIAL_ESC     0xDB
+#define SERIAL_ESC_END 0xDC
+#define SERIAL_ESC_ESC 0xDD
+
+// Maximum size of the records of a frame sent, and of a frame received [bytes]
+#define SERIAL_FRAME_MAX 96
+#define SERIAL_INPUT_MAX 16
+
+// Frames received kept until the process reads them (a power of two): the server may write
+// several frames back to back
+#define SERIAL_INPUT_FRAMES 4
+
+// Size of the uplink buffer [bytes], and number of bytes waiting that triggers a flush
+#define UPLINK_BUFFER     256
+#define UPLINK_FLUSH_SIZE 64
+
+// Time after which a record waiting is flushed, and its slack
+#define UPLINK_FLUSH_TIME  (CLOCK_SECOND/4)
+#define UPLINK_FLUSH_SLACK (CLOCK_SECOND/8)
+
+// Rate of the UART [bits/sec] (10 bits per byte), and share of it the frames may use [%]
+#ifndef UPLINK_BAUD
+#define UPLINK_BAUD 115200
+#endif
+#ifndef UPLINK_SHARE
+#define UPLINK_SHARE 25
+#endif
+
+// Period of the REC_UPLINK records [sec]
+#define UPLINK_REPORT 60
+
+// Records sent by the root
+#define REC_LIGHT       0x01	// src u16, level u16 [, hops u8, residence u16 (ms)]
+#define REC_PATH        0x02	// kind u8 (REC_PATH_DAO or REC_PATH_ACK), src u16, typeMote u8
+				// [, hops u8, residence u16 (ms)]
+#define REC_CMD         0x03	// id u8, typeMote u8, acked u8, expected u8, latency u32 (ms), missing u8...
+#define REC_TRACE       0x04	// id u8, src u16, rtt u32 (ms), hops u8, (node u8, delay u16 (ms))...
+#define REC_LATE_ACK    0x05	// id u8, src u16
+#define REC_LATE_ACKAGG 0x06	// id u8, count u8
+#define REC_ENERGY      0x07	// src u16, period u16 (sec), cpu, lpm, listen, transmit u32 (ms),
+				// tx u16 (ms) per class, rx u16 (ms) per class, readings u8,
+				// drops u16 (since the boot), routes u8
+#define REC_UPLINK      0x08	// period u16 (sec), bytes u32, frames u16, records u16, dropped u16,
+				// peak u16 (bytes buffered), utilization u16 (per mille of the UART),
+				// input dropped u16 (frames of the server lost, the input ring full)
+#define REC_ELIDED      0x09	// typeMote u8, on u8: command not sent, no actuator off (on: actuators still on)
+
+// Kinds of the REC_PATH records
+#define REC_PATH_DAO 0
+#define REC_PATH_ACK 1
+
+// Records sent by the server
+#define REC_COMMAND     0x40	// typeMote u8: turn on the actuators of that type
+
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Function handling a record received from the server
+typedef void (*serial_handler_t)(uint8_t type, const uint8_t *value, uint8_t len);
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Sets the input of the serial line, and starts the REC_UPLINK reports. The given process is
+ * polled when a frame is received.
+ */
+void serial_init(struct process *process);
+
+/**
+ * Checks the frames received, if any, and hands each of their records to the handler.
+ * Called by the process given to serial_init when it is polled.
+ */
+void serial_input(serial_handler_t handler);
+
+/**
+ * Starts a record of the given type. Its value is written with serial_u8, serial_u16 and
+ * serial_u32, and serial_end queues it. The bytes that don't fit in a frame are dropped.
+ */
+void serial_begin(uint8_t type);
+
+/**
+ * Writes an integer in the value of the current record.
+ */
+void serial_u8(uint8_t value);
+void serial_u16(uint16_t value);
+void serial_u32(uint32_t value);
+
+/**
+ * Ends the current record, and queues it in the uplink buffer.
+ */
+void serial_end();
+
+/**
+ * Sends the records waiting in the uplink buffer, as far as the share of the UART allows.
+ */
+void serial_flush();
+
+#endif /* SERIAL_PROTOCOL_H_ */
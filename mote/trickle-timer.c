@@ -13,34 +13,72 @@
  * Initializes a trickle timer, by setting its attributes to the default.
  */
 void trickle_init(trickle_timer_t* timer) {
-	timer->T = (uint8_t) T_MIN;
+	trickle_init_range(timer, CLOCK_SECOND, T_MIN, T_MAX);
+}
+
+/**
+ * Initializes a trickle timer with a custom range. T goes from T_min to T_max,
+ * expressed in units of the given number of clock ticks.
+ */
+void trickle_init_range(trickle_timer_t* timer, clock_time_t unit, uint8_t T_min, uint8_t T_max) {
+	timer->unit = unit;
+	timer->T_min = T_min;
+	timer->T_max = T_max;
+	timer->T = T_min;
+	timer->c = 0;
 }
 
 /**
  * Returns a random duration between T/2 and T.
  */
 uint16_t trickle_random(trickle_timer_t* timer) {
-	uint16_t min = CLOCK_SECOND * (timer->T)/2;
-	uint16_t max = CLOCK_SECOND * timer->T;
+	uint16_t min = timer->unit * (timer->T)/2;
+	uint16_t max = timer->unit * timer->T;
 	uint16_t random_delay = random_rand() % (max-min + 1) + min;
 	return random_delay;
 }
 
 /**
- * Updates the value of T, by doubling it (up to T_MAX).
+ * Returns the duration of the current interval, T units.
+ */
+clock_time_t trickle_interval(trickle_timer_t* timer) {
+	return timer->unit * timer->T;
+}
+
+/**
+ * Updates the value of T, by doubling it (up to T_max), and sets c to 0.
  */
 void trickle_update(trickle_timer_t* timer) {
-	uint8_t new_T = timer->T * 2;
-	if (new_T > T_MAX) {
-		timer->T = (uint8_t) T_MAX;
+	uint16_t new_T = timer->T * 2;
+	if (new_T > timer->T_max) {
+		timer->T = timer->T_max;
 	} else {
-		timer->T = new_T;
+		timer->T = (uint8_t) new_T;
 	}
+	timer->c = 0;
 }
 
 /**
- * Resets the timer, by setting T to T_MIN, and c to 0.
+ * Resets the timer, by setting T to T_min, and c to 0.
  */
 void trickle_reset(trickle_timer_t* timer) {
-	timer->T = (uint8_t) T_MIN;
+	timer->T = timer->T_min;
+	timer->c = 0;
+}
+
+/**
+ * Records that a consistent message has been heard during the current interval.
+ */
+void trickle_consistent(trickle_timer_t* timer) {
+	if (timer->c < 255) {
+		timer->c++;
+	}
+}
+
+/**
+ * Returns 1 if less than k consistent messages have been heard during the current
+ * interval, meaning that the mote should transmit. Returns 0 otherwise.
+ */
+uint8_t trickle_should_transmit(trickle_timer_t* timer, uint8_t k) {
+	return timer->c < k;
 }
@@ -2,6 +2,9 @@
  * Trickle timer for the sending of periodic control messages.
  */
 
+#ifndef TRICKLE_TIMER_H_
+#define TRICKLE_TIMER_H_
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -24,6 +27,10 @@
 
 typedef struct trickle_timer {
 	uint8_t T;
+	uint8_t T_min;
+	uint8_t T_max;
+	uint8_t c;		// Consistent messages heard during the current interval
+	clock_time_t unit;	// Duration of one unit of T [clock ticks]
 } trickle_timer_t;
 
 
@@ -37,17 +44,41 @@ typedef struct trickle_timer {
  */
 void trickle_init(trickle_timer_t* timer);
 
+/**
+ * Initializes a trickle timer with a custom range. T goes from T_min to T_max,
+ * expressed in units of the given number of clock ticks.
+ */
+void trickle_init_range(trickle_timer_t* timer, clock_time_t unit, uint8_t T_min, uint8_t T_max);
+
 /**
  * Returns a random duration between T/2 and T.
  */
 uint16_t trickle_random(trickle_timer_t* timer);
 
 /**
- * Updates the value of T, by doubling it (up to T_MAX)
+ * Returns the duration of the current interval, T units.
+ */
+clock_time_t trickle_interval(trickle_timer_t* timer);
+
+/**
+ * Updates the value of T, by doubling it (up to T_max), and sets c to 0.
  */
 void trickle_update(trickle_timer_t* timer);
 
 /**
- * Resets the timer, by setting T to T_MIN, and c to 0.
+ * Records that a consistent message has been heard during the current interval.
  */
-void trickle_reset(trickle_timer_t* timer);
\ No newline at end of file
+void trickle_consistent(trickle_timer_t* timer);
+
+/**
+ * Returns 1 if less than k consistent messages have been heard during the current
+ * interval, meaning that the mote should transmit. Returns 0 otherwise.
+ */
+uint8_t trickle_should_transmit(trickle_timer_t* timer, uint8_t k);
+
+/**
+ * Resets the timer, by setting T to T_min, and c to 0.
+ */
+void trickle_reset(trickle_timer_t* timer);
+
+#endif /* TRICKLE_TIMER_H_ */
@@ -0,0 +1,231 @@
+/**
+ * Transmit queue of the motes, with priority classes.
+ */
+
+#include "tx-queue.h"
+#include "energy.h"
+#include "power.h"
+#include "sys/log.h"
+
+#define LOG_MODULE "App"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Represents a frame waiting to be sent
+typedef struct tx_frame {
+	uint8_t data[sizeof(any_message_t)];
+	uint8_t len;
+	uint8_t broadcast;
+	linkaddr_t dest;
+	clock_time_t enqueued;
+} tx_frame_t;
+
+// Represents the circular queue of a class
+typedef struct tx_class {
+	tx_frame_t *frames;
+	uint8_t depth;
+	uint8_t head;		// index of the oldest frame
+	uint8_t length;
+	uint16_t drops;
+} tx_class_t;
+
+static tx_frame_t control_frames[TX_DEPTH_CONTROL];
+static tx_frame_t command_frames[TX_DEPTH_COMMAND];
+static tx_frame_t data_frames[TX_DEPTH_DATA];
+
+static tx_class_t classes[TX_CLASSES] = {
+	{ control_frames, TX_DEPTH_CONTROL, 0, 0, 0 },
+	{ command_frames, TX_DEPTH_COMMAND, 0, 0, 0 },
+	{ data_frames,    TX_DEPTH_DATA,    0, 0, 0 },
+};
+
+// 1 while a frame is handed to the MAC
+static uint8_t in_flight = 0;
+
+// Sequence number of the last frame handed to the MAC, given back by its callback
+static uint8_t tx_seq = 0;
+
+// Receiver of the frame handed to the MAC, NULL for a broadcast
+static const linkaddr_t *in_flight_dest = NULL;
+static linkaddr_t in_flight_addr;
+
+// Moving average of the retransmissions and failures of the MAC, in 16ths
+static uint8_t mac_stress = 0;
+
+// Congestion state, with hysteresis
+static uint8_t congested = 0;
+
+// Callback timer to recover if the MAC never reports the end of a transmission
+static struct ctimer watchdog_timer;
+
+PROCESS(tx_process, "Transmit queue");
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Starts the process that sends the frames of the queue.
+ */
+void tx_init() {
+	if (!process_is_running(&tx_process)) {
+		process_start(&tx_process, NULL);
+	}
+}
+
+/**
+ * Copies a frame in the queue of the given class. The frame is broadcast if dest is NULL.
+ * When the class is full, a data frame replaces the oldest data frame,
+ * any other frame is dropped.
+ */
+void tx_enqueue(uint8_t class, const void *frame, uint16_t len, const linkaddr_t *dest) {
+	tx_class_t *queue = &classes[class];
+
+	if (len > sizeof(any_message_t)) {
+		LOG_INFO("Frame of %u bytes too long for the transmit queue\n", len);
+		return;
+	}
+	if (queue->length == queue->depth) {
+		queue->drops++;
+		if (class != TX_CLASS_DATA) {
+			LOG_INFO("Transmit queue %u full, frame dropped (%u drops)\n", class, queue->drops);
+			return;
+		}
+		// Drop the oldest data frame, the newest reading is more useful
+		queue->head = (queue->head + 1) % queue->depth;
+		queue->length--;
+	}
+
+	tx_frame_t *slot = &(queue->frames[(queue->head + queue->length) % queue->depth]);
+	memcpy(slot->data, frame, len);
+	slot->len = len;
+	slot->broadcast = (dest == NULL);
+	if (dest != NULL) {
+		linkaddr_copy(&(slot->dest), dest);
+	}
+	slot->enqueued = clock_time();
+	queue->length++;
+
+	// Sent by the process, never from the caller: the caller may still be reading the packetbuf
+	process_poll(&tx_process);
+}
+
+/**
+ * Returns the number of frames of the given class dropped because its queue was full.
+ */
+uint16_t tx_drops(uint8_t class) {
+	return classes[class].drops;
+}
+
+/**
+ * Returns the number of frames waiting in the given class.
+ */
+uint8_t tx_length(uint8_t class) {
+	return classes[class].length;
+}
+
+/**
+ * Returns 1 if the mote is congested: its data queue is filling up, or the MAC
+ * needs retransmissions for a large share of the frames.
+ */
+uint8_t tx_congested() {
+	uint8_t occupancy = classes[TX_CLASS_DATA].length * 16 / TX_DEPTH_DATA;
+	uint8_t level = occupancy > mac_stress ? occupancy : mac_stress;
+	if (level >= TX_CONGESTION_ON) {
+		congested = 1;
+	} else if (level < TX_CONGESTION_OFF) {
+		congested = 0;
+	}
+	return congested;
+}
+
+/**
+ * Callback function, called by the MAC when it is done with a frame. The end of a frame the
+ * watchdog already gave up on is ignored: the next frame is the one in flight.
+ */
+static void tx_sent(void *ptr, int status, int transmissions) {
+	if (!in_flight || (uint8_t) (uintptr_t) ptr != tx_seq) {
+		LOG_INFO("Late answer of the MAC for an abandoned frame, ignored\n");
+		return;
+	}
+
+	// A failed frame counts fully, a frame sent after retransmissions counts in part
+	uint8_t sample = 16;
+	if (status == MAC_TX_OK) {
+		sample = transmissions > 2 ? 16 : (transmissions - 1) * 8;
+	}
+	mac_stress = (mac_stress * 3 + sample) / 4;
+
+	ctimer_stop(&watchdog_timer);
+	energy_tx_done();
+	power_tx_done(in_flight_dest, status);
+	in_flight = 0;
+	process_poll(&tx_process);
+}
+
+/**
+ * Callback function, called if the MAC didn't report the end of a transmission in time.
+ */
+static void watchdog_callback(void *ptr) {
+	LOG_INFO("No answer from the MAC, sending the next frame\n");
+	energy_tx_done();
+	power_tx_done(in_flight_dest, MAC_TX_ERR);
+	in_flight = 0;
+	process_poll(&tx_process);
+}
+
+/**
+ * Hands the oldest frame of the highest priority class to the MAC, if there is one.
+ */
+static void tx_next() {
+	uint8_t class;
+	for (class = 0; class < TX_CLASSES; class++) {
+		if (classes[class].length > 0) {
+			break;
+		}
+	}
+	if (class == TX_CLASSES) {
+		return;
+	}
+	tx_class_t *queue = &classes[class];
+	tx_frame_t *frame = &(queue->frames[queue->head]);
+	queue->head = (queue->head + 1) % queue->depth;
+	queue->length--;
+
+	// The time spent in the queue counts in the residence time and in the trace of the frame
+	stamp_queue_delay(frame->data, frame->len, clock_time() - frame->enqueued);
+
+	// Same packetbuf as the output of NullNet, which gives no callback to the MAC
+	packetbuf_clear();
+	packetbuf_copyfrom(frame->data, frame->len);
+	packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, frame->broadcast ? &linkaddr_null : &(frame->dest));
+	packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+
+	in_flight = 1;
+	linkaddr_copy(&in_flight_addr, &(frame->dest));
+	in_flight_dest = frame->broadcast ? NULL : &in_flight_addr;
+	energy_tx_start(frame->data, frame->len);
+	power_tx_start();
+	ctimer_set(&watchdog_timer, TX_TIMEOUT, watchdog_callback, NULL);
+	tx_seq++;
+	NETSTACK_MAC.send(tx_sent, (void*) (uintptr_t) tx_seq);
+}
+
+PROCESS_THREAD(tx_process, ev, data) {
+	PROCESS_BEGIN();
+
+	while(1) {
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+		if (!in_flight) {
+			tx_next();
+		}
+	}
+
+	PROCESS_END();
+}
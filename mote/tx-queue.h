@@ -0,0 +1,99 @@
+/**
+ * Transmit queue of the motes, with priority classes.
+ *
+ * The send and forward functions of the routing layer don't hand their frames to the MAC
+ * directly: they copy them in the queue of their class, and a process sends them one at a
+ * time, routing control first, then actuator commands and ACKs, then sensor data.
+ * The next frame is only handed to the MAC when the previous one is done, so the queues
+ * fill up (and drop) when the MAC is slow, instead of the MAC losing frames silently.
+ * The frames are handed to the MAC as the output of NullNet does, but with a callback:
+ * NullNet gives none, and the queue needs the end of each transmission.
+ */
+
+#ifndef TX_QUEUE_H_
+#define TX_QUEUE_H_
+
+#include "routing.h"
+
+
+///////////////////
+///  CONSTANTS  ///
+///////////////////
+
+// Priority classes, from the highest to the lowest priority
+#define TX_CLASS_CONTROL 0	// DIS, DIO, DAO
+#define TX_CLASS_COMMAND 1	// TURNON, MPL, ACK, ACKAGG, MAINT, MAINTACK
+#define TX_CLASS_DATA    2	// LIGHT, ENERGY
+#define TX_CLASSES       3
+
+// Maximum number of frames waiting in each class
+#define TX_DEPTH_CONTROL 3
+#define TX_DEPTH_COMMAND 4
+#define TX_DEPTH_DATA    4
+
+// Congestion thresholds, in 16ths: occupancy of the data queue, or share of the recent
+// frames that needed retransmissions or failed. Congested above ON, until back below OFF.
+#define TX_CONGESTION_ON  8
+#define TX_CONGESTION_OFF 4
+
+// Time after which a frame handed to the MAC is considered lost if the MAC didn't answer
+#define TX_TIMEOUT (CLOCK_SECOND*2)
+
+
+
+////////////////////
+///  DATA TYPES  ///
+////////////////////
+
+// Any of the messages, used to size the frames of the queue
+typedef union any_message {
+	DIS_message_t dis;
+	DIO_message_t dio;
+	DAO_message_t dao;
+	LIGHT_message_t light;
+	TURNON_message_t turnon;
+	ACK_message_t ack;
+	ACKAGG_message_t ackagg;
+	MAINT_message_t maint;
+	MAINTACK_message_t maintack;
+	MPL_message_t mpl;
+#if ENERGY_REPORTS
+	ENERGY_message_t energy;
+#endif
+} any_message_t;
+
+
+
+///////////////////
+///  FUNCTIONS  ///
+///////////////////
+
+/**
+ * Starts the process that sends the frames of the queue.
+ */
+void tx_init();
+
+/**
+ * Copies a frame in the queue of the given class. The frame is broadcast if dest is NULL.
+ * When the class is full, a data frame replaces the oldest data frame,
+ * any other frame is dropped.
+ */
+void tx_enqueue(uint8_t class, const void *frame, uint16_t len, const linkaddr_t *dest);
+
+/**
+ * Returns the number of frames of the given class dropped because its queue was full.
+ */
+uint16_t tx_drops(uint8_t class);
+
+/**
+ * Returns the number of frames waiting in the given class.
+ */
+uint8_t tx_length(uint8_t class);
+
+/**
+ * Returns 1 if the mote is congested: its data queue is filling up, or the MAC
+ * needs retransmissions for a large share of the frames.
+ */
+uint8_t tx_congested();
+
+#endif /* TX_QUEUE_H_ */
@@ -0,0 +1,247 @@
+"""
+Record and replay of the serial traffic between the root mote and the server.
+
+record: sits between serv.py and the serial socket of Cooja (or a gateway), forwards the bytes both
+ways, and writes them to a capture with their time and direction. The server connects to the listening
+port instead of the root.
+	python3 replay.py record --listen 60101 --root localhost:60001 capture.cap
+	python3 serv.py --port 60101
+
+replay: feeds the root side of a capture to the processing of serv.py in this process, as fast as possible
+or at a given speed, and records the commands it decides. The clock of the rules is driven by the times of
+the capture, so a replay decides the same commands at any speed: the commands of a replay are the reference
+of the next ones (--expect), and are compared with those of the capture.
+	python3 replay.py replay --commands reference.txt capture.cap
+	python3 replay.py replay --expect reference.txt capture.cap
+
+show: prints the records of a capture.
+
+A capture is a header (CAPTURE_MAGIC) followed by chunks: time since the start of the capture, direction
+and length (CHUNK), then the bytes as they went through the socket, text logs of the root included.
+The throughput of the server over its connections is measured with gateway_emulator.py.
+"""
+
+import argparse
+import asyncio
+import contextlib
+import os
+import struct
+import sys
+import time
+
+import serv
+from serial_protocol import Decoder, parseRecord, REC_COMMAND
+
+CAPTURE_MAGIC = b"MOTECAP1"
+# Chunk of a capture: time since the start of the capture [sec], direction, number of bytes
+CHUNK = struct.Struct("<dBI")
+# Directions of the chunks
+ROOT_TO_SERVER = 0
+SERVER_TO_ROOT = 1
+
+# Bytes read at once from a socket
+READ_SIZE = 65536
+
+
+class Capture:
+	"""
+	Capture file being written: the chunks are timed from the creation of the capture.
+	"""
+	def __init__(self, path):
+		self.file = open(path, "wb")
+		self.file.write(CAPTURE_MAGIC)
+		self.start = time.monotonic()
+		self.chunks = 0
+
+	def write(self, direction, data):
+		self.file.write(CHUNK.pack(time.monotonic() - self.start, direction, len(data)) + data)
+		self.chunks += 1
+
+	def close(self):
+		self.file.close()
+
+
+def readCapture(path):
+	"""
+	Returns the (time, direction, bytes) chunks of a capture.
+	"""
+	with open(path, "rb") as file:
+		data = file.read()
+	if not data.startswith(CAPTURE_MAGIC):
+		raise ValueError(f"{path} is not a capture")
+	chunks = []
+	offset = len(CAPTURE_MAGIC)
+	while offset + CHUNK.size <= len(data):
+		at, direction, length = CHUNK.unpack_from(data, offset)
+		offset += CHUNK.size
+		chunks.append((at, direction, data[offset:offset + length]))
+		offset += length
+	return chunks
+
+
+def commandsOf(chunks):
+	"""
+	Returns the (time, typeMote) commands sent by the server in the chunks.
+	"""
+	decoder = Decoder()
+	commands = []
+	for at, direction, data in chunks:
+		if direction == SERVER_TO_ROOT:
+			commands += [(at, item[2][0]) for item in decoder.feed(data) if item[0] == "record" and item[1] == REC_COMMAND and item[2]]
+	return commands
+
+
+async def pipe(reader, writer, capture, direction):
+	"""
+	Function used to forward the bytes of one direction of the connection, writing them to the capture.
+	"""
+	try:
+		while True:
+			data = await reader.read(READ_SIZE)
+			if not data:
+				break
+			capture.write(direction, data)
+			writer.write(data)
+			await writer.drain()
+	except OSError:
+		pass
+	finally:
+		writer.close()
+
+
+async def record(args):
+	"""
+	Function used to capture the traffic of one connection of the server to the root.
+	"""
+	rootIp, _, rootPort = args.root.rpartition(":")
+	done = asyncio.Event()
+
+	async def serve(serverReader, serverWriter):
+		rootReader, rootWriter = await asyncio.open_connection(rootIp or "localhost", int(rootPort))
+		capture = Capture(args.capture)
+		print(f"Recording to {args.capture}")
+		await asyncio.gather(pipe(rootReader, serverWriter, capture, ROOT_TO_SERVER),
+			pipe(serverReader, rootWriter, capture, SERVER_TO_ROOT))
+		capture.close()
+		print(f"Recorded {capture.chunks} chunks over {time.monotonic() - capture.start:.1f} s")
+		done.set()
+
+	server = await asyncio.start_server(serve, args.ip, args.listen)
+	async with server:
+		await done.wait()
+
+
+def replay(args):
+	"""
+	Function used to feed the root side of a capture to the processing of serv.py, its clock driven by the
+	times of the capture, and to record the commands it decides. The rules are ticked every RULES_TICK of
+	the capture as control() does, so the commands are the same at any speed.
+	"""
+	chunks = readCapture(args.capture)
+	now = [0.0]	# time of the capture being replayed [sec]
+	replayed = []
+
+	def send(record):
+		replayed.append((now[0], record[1][0]))
+		return True
+
+	serv.clock = lambda: now[0]
+	gateway = serv.Gateway("capture", 0)
+	gateway.send = send
+	gateway.connected = True
+	serv.gateways.append(gateway)
+	decoder = Decoder()
+	output = sys.stdout if args.verbose else open(os.devnull, "w")
+	start = time.monotonic()
+	sent = 0
+	with contextlib.redirect_stdout(output):
+		serv.water()
+		nextTick = 1
+		end = max((at for at, _, _ in chunks), default=0) + args.linger
+		for at, direction, data in chunks + [(end, ROOT_TO_SERVER, b"")]:
+			if direction != ROOT_TO_SERVER:
+				continue
+			while nextTick <= at:
+				now[0] = nextTick
+				serv.applyRules()
+				nextTick += serv.RULES_TICK
+			now[0] = at
+			if args.speed:
+				delay = start + at / args.speed - time.monotonic()
+				if delay > 0:
+					time.sleep(delay)
+			serv.processItems(decoder.feed(data), gateway)
+			sent += len(data)
+	if not args.verbose:
+		output.close()
+	elapsed = time.monotonic() - start
+	print(f"Replayed {sent} bytes of {end - args.linger:.1f} s in {elapsed:.1f} s ({sent / max(elapsed, 1e-6) / 1000:.0f} kB/s)")
+	lines = [f"{at:.3f} {typeMote}\n" for at, typeMote in replayed]
+	if args.commands:
+		with open(args.commands, "w") as file:
+			file.writelines(lines)
+	compare(commandsOf(chunks), replayed)
+	if args.expect:
+		with open(args.expect) as file:
+			expected = file.readlines()
+		if expected != lines:
+			print(f"Regression: the commands differ from {args.expect}")
+			return 1
+		print(f"Same commands as {args.expect}")
+	return 0
+
+
+def compare(recorded, replayed):
+	"""
+	Function used to print the differences between the commands of the capture and those of the replay.
+	The live server ticked its rules at its own times, and its commands went through the connection:
+	their times differ from the replay by up to RULES_TICK, and some may be missing at the edges.
+	"""
+	print(f"Commands: {len(recorded)} in the capture, {len(replayed)} replayed")
+	for i in range(max(len(recorded), len(replayed))):
+		old = f"{recorded[i][0]:8.3f} s type {recorded[i][1]}" if i < len(recorded) else "-"
+		new = f"{replayed[i][0]:8.3f} s type {replayed[i][1]}" if i < len(replayed) else "-"
+		if i >= len(recorded) or i >= len(replayed) or recorded[i][1] != replayed[i][1]:
+			print(f"  #{i}: capture {old}, replay {new}")
+
+
+def show(args):
+	"""
+	Function used to print the records and the logs of a capture.
+	"""
+	decoders = {ROOT_TO_SERVER: Decoder(), SERVER_TO_ROOT: Decoder()}
+	names = {ROOT_TO_SERVER: "root>server", SERVER_TO_ROOT: "server>root"}
+	for at, direction, data in readCapture(args.capture):
+		for item in decoders[direction].feed(data):
+			if item[0] == "text":
+				print(f"{at:10.3f} {names[direction]} log {item[1]}")
+			elif item[1] == REC_COMMAND:
+				print(f"{at:10.3f} {names[direction]} COMMAND type {item[2][0] if item[2] else None}")
+			else:
+				print(f"{at:10.3f} {names[direction]} {parseRecord(item[1], item[2])}")
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description="Records and replays the serial traffic of the root")
+	subparsers = parser.add_subparsers(dest="mode", required=True)
+	recordParser = subparsers.add_parser("record", help="capture the traffic between the server and the root")
+	recordParser.add_argument("--ip", default="localhost")
+	recordParser.add_argument("--listen", type=int, default=60101, help="port the server connects to")
+	recordParser.add_argument("--root", default="localhost:60001", help="ip:port of the serial socket of the root")
+	recordParser.add_argument("capture")
+	replayParser = subparsers.add_parser("replay", help="feed a capture to the processing of the server")
+	replayParser.add_argument("--speed", type=float, default=0, help="speed of the replay, 0 for as fast as possible")
+	replayParser.add_argument("--linger", type=float, default=2, help="time the rules run after the capture [sec]")
+	replayParser.add_argument("--commands", help="file to write the commands of the replay to")
+	replayParser.add_argument("--expect", help="commands file of a previous replay that the commands must match")
+	replayParser.add_argument("--verbose", action="store_true", help="print the output of the server")
+	replayParser.add_argument("capture")
+	showParser = subparsers.add_parser("show", help="print the records of a capture")
+	showParser.add_argument("capture")
+	args = parser.parse_args()
+	if args.mode == "show":
+		show(args)
+	elif args.mode == "replay":
+		sys.exit(replay(args))
+	else:
+		asyncio.run(record(args))
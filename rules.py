@@ -0,0 +1,117 @@
+"""
+Control rules of the server: when to turn on the lightbulbs and the sprinklers of each zone.
+
+The commands follow the state of the zones instead of the readings. The light level of a zone is
+the median of the last reading of each of its sensors over a window, and a zone becomes dark under
+LIGHT_ON and light again over LIGHT_OFF. The actuators of a zone that must be on are commanded once,
+and then again only when the time they stay on after a command (TIMEOUT_LIGHT and TIMEOUT_WATER of
+the motes) is about to end, or soon after a command that some of them did not acknowledge.
+"""
+
+import statistics
+import time
+
+# Types of the actuators
+SPRINKLER = 3
+LIGHTBULB = 4
+
+# Light level under which a zone is dark, and over which it is light again
+LIGHT_ON = 400
+LIGHT_OFF = 450
+# Window over which the readings of the sensors of a zone are aggregated [sec] (a sensor reports every ~60 s)
+LIGHT_WINDOW = 90
+
+# Time the actuators stay on after a command [sec] (routing.h)
+ON_DURATION = {SPRINKLER: 180, LIGHTBULB: 120}
+# Time before the end of the on-duration at which the command is renewed [sec]
+RENEW_MARGIN = 15
+# Time after which a command that was not acknowledged by all its actuators is sent again [sec]
+RETRY_INTERVAL = 10
+
+
+class Zone:
+	"""
+	Light level of a zone: the last reading of each of its sensors, and whether it is dark.
+	"""
+	def __init__(self):
+		self.readings = {}	# sensor -> (level, time of the reading)
+		self.dark = False
+
+	def add(self, sensor, level, now):
+		"""
+		Adds a reading, and returns the level of the zone: the median of the readings of the window.
+		"""
+		self.readings[sensor] = (level, now)
+		for name in [name for name, (_, seen) in self.readings.items() if now - seen > LIGHT_WINDOW]:
+			del self.readings[name]
+		return statistics.median(level for level, _ in self.readings.values())
+
+
+class Rules:
+	"""
+	Rules of all the zones. light and tick return the (zone, typeMote) commands to send.
+	"""
+	def __init__(self):
+		self.zones = {}
+		self.wanted = set()	# (zone, typeMote) of the actuators that must be on
+		self.nextCommand = {}	# (zone, typeMote) -> time from which the actuators must be commanded again
+		self.readings = 0
+		self.commands = 0
+
+	def light(self, zone, sensor, level, now=None):
+		"""
+		Function used to process a light reading of a sensor of a zone. A zone that becomes dark wants its
+		lightbulbs on, and they are commanded right away; a zone that becomes light lets them go off.
+		"""
+		now = time.monotonic() if now is None else now
+		self.readings += 1
+		state = self.zones.setdefault(zone, Zone())
+		zoneLevel = state.add(sensor, level, now)
+		if not state.dark and zoneLevel < LIGHT_ON:
+			state.dark = True
+			self.wanted.add((zone, LIGHTBULB))
+			print(f"Zone {zone}: dark (level {zoneLevel:.0f} over {len(state.readings)} sensors), lightbulbs on")
+		elif state.dark and zoneLevel > LIGHT_OFF:
+			state.dark = False
+			self.wanted.discard((zone, LIGHTBULB))
+			print(f"Zone {zone}: light (level {zoneLevel:.0f} over {len(state.readings)} sensors), lightbulbs let off")
+		return self.tick(now)
+
+	def water(self, zone):
+		"""
+		Function used to keep the sprinklers of a zone on.
+		"""
+		self.wanted.add((zone, SPRINKLER))
+
+	def acknowledged(self, zone, typeMote, acked, expected, now=None):
+		"""
+		Function used to process the report of a command: when some actuators did not acknowledge it, it is
+		sent again after RETRY_INTERVAL instead of at the end of the on-duration.
+		"""
+		now = time.monotonic() if now is None else now
+		target = (zone, typeMote)
+		if acked < expected and target in self.wanted:
+			self.nextCommand[target] = min(self.nextCommand.get(target, now), now + RETRY_INTERVAL)
+
+	def unsent(self, zone, typeMote, now=None):
+		"""
+		Function used to process a command that could not be sent, its gateway not connected yet: it is sent
+		again after RETRY_INTERVAL.
+		"""
+		now = time.monotonic() if now is None else now
+		target = (zone, typeMote)
+		if target in self.wanted:
+			self.nextCommand[target] = min(self.nextCommand.get(target, now), now + RETRY_INTERVAL)
+
+	def tick(self, now=None):
+		"""
+		Returns the commands due: the actuators that must be on, and were not commanded or are about to go off.
+		"""
+		now = time.monotonic() if now is None else now
+		due = []
+		for target in sorted(self.wanted):
+			if now >= self.nextCommand.get(target, now):
+				self.nextCommand[target] = now + ON_DURATION[target[1]] - RENEW_MARGIN
+				due.append(target)
+		self.commands += len(due)
+		return due
@@ -0,0 +1,188 @@
+"""
+Binary protocol between the root mote and the server, on the serial line (see mote/serial-protocol.h).
+
+A frame is a sequence of TLV records (type, length, value) followed by the CRC-16 of the records
+(lib/crc16 of Contiki), delimited by SLIP END bytes, with END and ESC escaped inside.
+The integers are little endian. The logs of the root are text lines between the frames.
+"""
+
+import struct
+
+# SLIP bytes
+END = 0xC0
+ESC = 0xDB
+ESC_END = 0xDC
+ESC_ESC = 0xDD
+
+# Records sent by the root
+REC_LIGHT = 0x01
+REC_PATH = 0x02
+REC_CMD = 0x03
+REC_TRACE = 0x04
+REC_LATE_ACK = 0x05
+REC_LATE_ACKAGG = 0x06
+REC_ENERGY = 0x07
+REC_UPLINK = 0x08
+REC_ELIDED = 0x09
+
+# Records sent by the server
+REC_COMMAND = 0x40
+
+# Kinds of the REC_PATH records
+PATH_KINDS = {0: "DAO", 1: "ACK"}
+
+# Message classes of the radio time in the REC_ENERGY records, in the order of the mote (energy.h)
+ENERGY_CLASSES = ["DIO", "DAO", "LIGHT", "FORWARD", "COMMAND", "REPORT"]
+
+# Frames longer than this are the bytes of a lost synchronization [bytes]
+FRAME_MAX = 512
+# Largest frame the root receives, records and CRC [bytes] (SERIAL_INPUT_MAX)
+INPUT_MAX = 16
+
+
+def crc16(data, crc=0):
+	"""
+	Returns the CRC-16 of the data, as computed by crc16_data of Contiki (CCITT, reflected).
+	"""
+	for byte in data:
+		crc ^= byte
+		for _ in range(8):
+			crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+	return crc
+
+
+def encodeFrame(records):
+	"""
+	Returns the frame of the given records, a list of (type, value bytes).
+	"""
+	payload = b"".join(bytes([recType, len(value)]) + value for recType, value in records)
+	payload += struct.pack("<H", crc16(payload))
+	payload = payload.replace(bytes([ESC]), bytes([ESC, ESC_ESC])).replace(bytes([END]), bytes([ESC, ESC_END]))
+	return bytes([END]) + payload + bytes([END])
+
+
+def commandRecord(typeMote):
+	"""
+	Returns the record that makes the root turn on the actuators of the given type.
+	"""
+	return (REC_COMMAND, bytes([typeMote]))
+
+
+def splitRecords(payload):
+	"""
+	Returns the (type, value) records of the payload of a frame, or None if its CRC or its lengths are wrong.
+	"""
+	if len(payload) < 2 or crc16(payload[:-2]) != struct.unpack_from("<H", payload, len(payload) - 2)[0]:
+		return None
+	records = []
+	i, end = 0, len(payload) - 2
+	while i < end:
+		if i + 2 > end or i + 2 + payload[i + 1] > end:
+			return None
+		records.append((payload[i], bytes(payload[i + 2:i + 2 + payload[i + 1]])))
+		i += 2 + payload[i + 1]
+	return records
+
+
+class Decoder:
+	"""
+	Splits the bytes of the serial line into the records of the frames and the text lines of the logs.
+	Each byte is looked at once. A frame with a wrong CRC means that an END was lost: its bytes are
+	given back as text, and the END that closed it starts the next frame.
+	"""
+	def __init__(self):
+		self.text = bytearray()
+		self.frame = None	# bytes of the current frame, None between the frames
+		self.escaped = False
+		self.errors = 0
+
+	def feed(self, data):
+		"""
+		Returns the items of the data, in order: ("record", type, value) and ("text", line).
+		"""
+		items = []
+		for byte in data:
+			if self.frame is None:
+				if byte == END:
+					self.frame = bytearray()
+					self.escaped = False
+				elif byte == ord("\n"):
+					items.append(("text", self.text.decode(errors="replace").strip()))
+					self.text.clear()
+				else:
+					self.text.append(byte)
+			elif byte == END:
+				if not self.frame:
+					continue	# empty frame: this END starts the frame
+				records = splitRecords(self.frame)
+				if records is None:
+					self.errors += 1
+					self.text += self.frame
+					self.frame = bytearray()
+				else:
+					items.extend(("record", recType, value) for recType, value in records)
+					self.frame = None
+				self.escaped = False
+			elif byte == ESC:
+				self.escaped = True
+			else:
+				if self.escaped:
+					byte = END if byte == ESC_END else ESC if byte == ESC_ESC else byte
+					self.escaped = False
+				self.frame.append(byte)
+				if len(self.frame) > FRAME_MAX:
+					self.errors += 1
+					self.text += self.frame
+					self.frame = None
+		return items
+
+
+def parseRecord(recType, value):
+	"""
+	Returns the fields of a record sent by the root as a dict, the name of its type in "type",
+	or None if the type is unknown or the record too short.
+	"""
+	if recType == REC_LIGHT and len(value) >= 4:
+		record = dict(zip(["src", "level"], struct.unpack_from("<HH", value)), type="LIGHT")
+		if len(value) >= 7:
+			record["hops"], record["residence"] = struct.unpack_from("<BH", value, 4)
+		return record
+	if recType == REC_PATH and len(value) >= 4:
+		kind, src, typeMote = struct.unpack_from("<BHB", value)
+		record = {"type": "PATH", "kind": PATH_KINDS.get(kind, str(kind)), "src": src, "typeMote": typeMote}
+		if len(value) >= 7:
+			record["hops"], record["residence"] = struct.unpack_from("<BH", value, 4)
+		return record
+	if recType == REC_CMD and len(value) >= 8:
+		cmdId, typeMote, acked, expected, latency = struct.unpack_from("<BBBBI", value)
+		return {"type": "CMD", "id": cmdId, "typeMote": typeMote, "acked": acked, "expected": expected,
+			"latency": latency, "missing": list(value[8:])}
+	if recType == REC_TRACE and len(value) >= 8:
+		cmdId, src, rtt, hops = struct.unpack_from("<BHIB", value)
+		records = [struct.unpack_from("<BH", value, i) for i in range(8, len(value) - 2, 3)]
+		return {"type": "TRACE", "id": cmdId, "src": src, "rtt": rtt, "hops": hops, "records": records}
+	if recType == REC_LATE_ACK and len(value) >= 3:
+		cmdId, src = struct.unpack_from("<BH", value)
+		return {"type": "LATE_ACK", "id": cmdId, "src": src}
+	if recType == REC_LATE_ACKAGG and len(value) >= 2:
+		cmdId, count = struct.unpack_from("<BB", value)
+		return {"type": "LATE_ACKAGG", "id": cmdId, "count": count}
+	classes = len(ENERGY_CLASSES)
+	energyFormat = f"<HHIIII{2 * classes}HB"
+	if recType == REC_ENERGY and len(value) >= struct.calcsize(energyFormat):
+		fields = struct.unpack_from(energyFormat, value)
+		record = {"type": "ENERGY", "src": fields[0], "period": fields[1],
+			"states": dict(zip(["CPU", "LPM", "LISTEN", "TRANSMIT"], fields[2:6])),
+			"tx": list(fields[6:6 + classes]), "rx": list(fields[6 + classes:6 + 2 * classes]), "readings": fields[-1]}
+		if len(value) >= struct.calcsize(energyFormat) + 3:
+			record["drops"], record["routes"] = struct.unpack_from("<HB", value, struct.calcsize(energyFormat))
+		return record
+	if recType == REC_ELIDED and len(value) >= 2:
+		typeMote, on = struct.unpack_from("<BB", value)
+		return {"type": "ELIDED", "typeMote": typeMote, "on": on}
+	if recType == REC_UPLINK and len(value) >= 16:
+		fields = struct.unpack_from("<HIHHHHH", value)
+		record = dict(zip(["period", "bytes", "frames", "records", "dropped", "peak", "utilization"], fields), type="UPLINK")
+		record["inputDropped"] = struct.unpack_from("<H", value, 16)[0] if len(value) >= 18 else 0
+		return record
+	return None
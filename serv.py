@@ -1,81 +1,649 @@
 #Based on the code given by teaching assistant Gorby Kabasele Ndonda
 
-import socket
 import argparse
-import sys
+import asyncio
+import collections
+import math
+import multiprocessing
+import os
 import time
-import threading
+
+from serial_protocol import Decoder, parseRecord, encodeFrame, commandRecord, ENERGY_CLASSES, INPUT_MAX
+from rules import Rules
+from tsdb import Store
+from metrics import Registry, serve as serveMetrics
 
 HOSTIP = 'localhost'
 HOSTPORT = 60001 
 
+# Bytes read at once from a gateway
+READ_SIZE = 65536
+# Chunks of decoded items waiting to be processed, from all the gateways: a full queue stops
+# the reading of the gateways until the processing catches up
+INGESTION_QUEUE = 256
+# Commands waiting to be sent to a gateway: a full queue means that the gateway does not read them
+COMMAND_QUEUE = 64
+# Period of the check of the commands due by the rules [sec]
+RULES_TICK = 1
+# Time after which a device that did not report anything is no longer behind its gateway [sec]
+DEVICE_TIMEOUT = 900
+
+# Period of the summaries of the residence times of the motes [sec]
+RESIDENCE_REPORT = 60
+
+# Type of the light sensors
+LIGHT_SENSOR = 2
+# Port of the metrics endpoint
+METRICS_PORT = 9108
+
+
+class Gateway:
+	"""
+	Connection to the root mote of a DODAG, through the serial socket of Cooja.
+	The records received are decoded and put in the ingestion queue, shared by all the gateways,
+	and the commands for the gateway wait in its own queue until the connection can take them.
+	"""
+	def __init__(self, ip, port, zone=None):
+		self.ip = ip
+		self.port = port
+		self.name = f"{ip}:{port}"
+		self.zone = zone or self.name	# the motes of a zone share their light level
+		self.commands = asyncio.Queue(COMMAND_QUEUE)
+		self.pending = set()	# records in the command queue
+		self.connected = False
+		self.droppedRecords = 0
+		self.droppedCommands = 0	# frames of commands the root could not keep
+		self.corruptedFrames = 0
+		self.lastData = None	# time of the last data received
+
+	def moteName(self, src):
+		"""
+		Returns the name of a mote behind the gateway. The addresses of the motes are only unique
+		behind one gateway, so they are prefixed by the gateway when there are several.
+		"""
+		return f"{self.name}/{src}" if len(gateways) > 1 or shards > 1 else str(src)
+
+	def send(self, record):
+		"""
+		Queues a record for the gateway, without waiting, and returns True if it was queued. A record already
+		waiting in the queue is not queued again, since sending it twice in a row would not change anything.
+		"""
+		if not self.connected or record in self.pending:
+			return False
+		try:
+			self.commands.put_nowait(record)
+			self.pending.add(record)
+			return True
+		except asyncio.QueueFull:
+			print(f"Gateway {self.name}: command queue full, command dropped")
+			commandsDropped.inc(self.name)
+			return False
+
+	async def run(self, ingestion):
+		"""
+		Reads the gateway until it closes the connection.
+		"""
+		try:
+			reader, writer = await asyncio.open_connection(self.ip, self.port)
+		except OSError as error:
+			print(f"Gateway {self.name}: cannot connect ({error})")
+			return
+		self.connected = True
+		gatewayConnections.inc(self.name)
+		sender = asyncio.create_task(self.sendCommands(writer))
+		decoder = Decoder()
+		try:
+			while True:
+				data = await reader.read(READ_SIZE)
+				if not data:
+					break
+				items = decoder.feed(data)
+				self.lastData = time.monotonic()
+				self.corruptedFrames = decoder.errors
+				if items:
+					await ingestion.put((self, items))
+		except OSError as error:
+			print(f"Gateway {self.name}: connection lost ({error})")
+		finally:
+			self.connected = False
+			sender.cancel()
+			writer.close()
+		print(f"Gateway {self.name}: closed, {decoder.errors} corrupted frames")
+
+	async def sendCommands(self, writer):
+		"""
+		Writes the queued commands to the gateway, waiting for the connection when it is full. The commands
+		queued together go in one frame, as far as the root can receive it: the root keeps only a few frames
+		until it reads them, and commands written back to back in their own frames could be lost.
+		"""
+		carried = None	# record that did not fit in the last frame
+		while True:
+			records = [carried or await self.commands.get()]
+			carried = None
+			size = 2 + len(records[0][1]) + 2	# record and CRC
+			while not self.commands.empty():
+				record = self.commands.get_nowait()
+				if size + 2 + len(record[1]) > INPUT_MAX:
+					carried = record
+					break
+				records.append(record)
+				size += 2 + len(record[1])
+			for record in records:
+				self.pending.discard(record)
+			writer.write(encodeFrame(records))
+			await writer.drain()
+
+
+class Directory:
+	"""
+	Devices behind each gateway, learned from their reports: the DAOs and the ACKs give the type of their
+	source, the other records only show that it is still there. A device that moves to another field
+	appears behind the new gateway, and expires behind the old one.
+	The gateways owning each type are indexed, and the index is rebuilt when a device or a type appears,
+	or every EXPIRY_CHECK seconds to expire the devices.
+	"""
+	EXPIRY_CHECK = 10
+
+	def __init__(self):
+		self.devices = {}	# (gateway, address) -> [typeMote or None, time of its last report]
+		self.index = None	# typeMote -> gateways owning such a device, and the known gateways under None
+		self.indexTime = 0
+
+	def seen(self, gateway, src, typeMote=None):
+		"""
+		Records a report of a device behind the gateway.
+		"""
+		device = self.devices.get((gateway, src))
+		if device is None:
+			device = self.devices[(gateway, src)] = [None, 0]
+			self.index = None
+		if typeMote is not None and device[0] != typeMote:
+			device[0] = typeMote
+			self.index = None
+		device[1] = clock()
+
+	def owners(self, typeMote, candidates):
+		"""
+		Returns the gateways of the candidates that have a device of the given type behind them. A gateway that
+		has not reported any device yet may have some: it is kept until it is known.
+		"""
+		now = clock()
+		if self.index is None or now - self.indexTime > self.EXPIRY_CHECK:
+			self.index = {None: set()}
+			for (gateway, address), (deviceType, lastSeen) in list(self.devices.items()):
+				if now - lastSeen > DEVICE_TIMEOUT:
+					del self.devices[(gateway, address)]
+					continue
+				self.index[None].add(gateway)
+				self.index.setdefault(deviceType, set()).add(gateway)
+			self.indexTime = now
+		owning = self.index.get(typeMote, ())
+		return [gateway for gateway in candidates if gateway in owning or gateway not in self.index[None]]
+
+
+# Clock of the rules and of the directory [sec]: replay.py drives it with the times of a capture
+clock = time.monotonic
+
+# Gateways served, the devices behind them, the rules deciding the commands, and the history of the readings.
+# Each shard (see runShards) is a process with its own copy of them, for the zones of its gateways
+shards = 1
+gateways = []
+directory = Directory()
+controls = Rules()
+store = None
+
+# Metrics exposed on the metrics endpoint (see metrics.py): readings and commands per gateway, latencies,
+# telemetry of the motes, and health of the connections
+metrics = Registry()
+recordsReceived = metrics.counter("wsn_records_total", "Records received from the gateways", ("gateway", "type"))
+readingsReceived = metrics.counter("wsn_readings_total", "Light readings received from the gateways", ("gateway",))
+commandsSent = metrics.counter("wsn_commands_total", "Commands queued for the gateways", ("gateway", "target"))
+commandsDropped = metrics.counter("wsn_commands_dropped_total", "Commands dropped because the queue of the gateway was full", ("gateway",))
+commandsElided = metrics.counter("wsn_commands_elided_total", "Commands not sent by the root since no actuator was off", ("gateway", "target"))
+commandReports = metrics.counter("wsn_command_reports_total", "Reports of the commands sent by the roots", ("gateway", "target"))
+commandAcks = metrics.counter("wsn_command_acks_total", "ACKs of the actuators in the reports of the commands", ("gateway", "target"))
+commandExpectedAcks = metrics.counter("wsn_command_expected_acks_total", "ACKs expected in the reports of the commands", ("gateway", "target"))
+commandLatencyHistogram = metrics.histogram("wsn_command_latency_ms", "Time until the last ACK of the commands", ("gateway", "target"))
+actuatorRttHistogram = metrics.histogram("wsn_actuator_rtt_ms", "Round trip time of the commands to the traced actuators")
+hopDelayHistogram = metrics.histogram("wsn_hop_delay_ms", "Time spent by the traced commands in each hop", ("hop",))
+residenceHistogram = metrics.histogram("wsn_residence_ms", "Time spent by the upward messages in the forwarders", ("kind",))
+moteForwarders = metrics.gauge("wsn_mote_forwarders", "Forwarders between the mote and its root", ("mote",))
+moteEnergyTotal = metrics.counter("wsn_mote_energy_mj_total", "Energy spent by the mote", ("mote",))
+moteDutyCycle = metrics.gauge("wsn_mote_radio_duty_cycle_ratio", "Share of the time with the radio on over the last energy period", ("mote",))
+moteRadio = metrics.counter("wsn_mote_radio_ms_total", "Radio time of the mote per message class", ("mote", "class", "direction"))
+moteReadingsSent = metrics.counter("wsn_mote_readings_sent_total", "Readings sent by the mote", ("mote",))
+moteReadingsDelivered = metrics.counter("wsn_mote_readings_delivered_total", "Readings of the mote delivered to the server", ("mote",))
+moteDrops = metrics.gauge("wsn_mote_queue_drops", "Frames dropped by the queues of the mote since its boot", ("mote",))
+moteRoutes = metrics.gauge("wsn_mote_routes", "Entries of the routing table of the mote", ("mote",))
+uplinkBytes = metrics.counter("wsn_uplink_bytes_total", "Bytes sent by the roots on their serial line", ("gateway",))
+uplinkDropped = metrics.counter("wsn_uplink_dropped_records_total", "Records dropped by the uplink buffer of the roots", ("gateway",))
+uplinkInputDropped = metrics.counter("wsn_uplink_input_dropped_frames_total", "Frames of commands dropped by the input ring of the roots", ("gateway",))
+uplinkUtilization = metrics.gauge("wsn_uplink_utilization_ratio", "Share of the serial line used by the root over its last report", ("gateway",))
+gatewayConnected = metrics.gauge("wsn_gateway_connected", "1 if the gateway is connected", ("gateway",))
+gatewayConnections = metrics.counter("wsn_gateway_connections_total", "Connections to the gateway", ("gateway",))
+gatewayCorrupted = metrics.counter("wsn_gateway_corrupted_frames_total", "Frames of the gateway with a wrong CRC over its last connection", ("gateway",))
+gatewayIdle = metrics.gauge("wsn_gateway_idle_seconds", "Time since the gateway sent data", ("gateway",))
+gatewayCommandQueue = metrics.gauge("wsn_gateway_command_queue", "Commands waiting to be sent to the gateway", ("gateway",))
+zoneDark = metrics.gauge("wsn_zone_dark", "1 if the zone is dark", ("zone",))
+devicesKnown = metrics.gauge("wsn_devices", "Devices known behind the gateways")
+ingestionQueue = metrics.gauge("wsn_ingestion_queue", "Chunks of the gateways waiting to be processed")
+storeDropped = metrics.gauge("wsn_store_dropped_readings", "Readings not stored because the store is full")
+
+def collectMetrics(ingestion):
+	"""
+	Function used to refresh the metrics that are states of the server before a scrape.
+	"""
+	now = time.monotonic()
+	for gateway in gateways:
+		gatewayConnected.set(gateway.name, value=int(gateway.connected))
+		gatewayCorrupted.set(gateway.name, value=gateway.corruptedFrames)
+		gatewayCommandQueue.set(gateway.name, value=gateway.commands.qsize())
+		if gateway.lastData is not None:
+			gatewayIdle.set(gateway.name, value=round(now - gateway.lastData, 3))
+	for zone, state in controls.zones.items():
+		zoneDark.set(zone, value=int(state.dark))
+	devicesKnown.set(value=len(directory.devices))
+	ingestionQueue.set(value=ingestion.qsize())
+	if store is not None:
+		storeDropped.set(value=store.dropped)
+
+
+def sendCommand(typeMote, zone=None):
+	"""
+	Function used to turn on the actuators of a type, in a zone or everywhere. The command is only sent to the
+	gateways that have such actuators behind them, and the rules send it again soon if one of them is not connected.
+	"""
+	candidates = [gateway for gateway in gateways if zone is None or gateway.zone == zone]
+	for gateway in directory.owners(typeMote, candidates):
+		if not gateway.connected:
+			controls.unsent(zone, typeMote, clock())
+		elif gateway.send(commandRecord(typeMote)):
+			commandsSent.inc(gateway.name, COMMAND_TYPES.get(typeMote, typeMote))
+
 
-def water(sock):
+def water():
 	"""
-	Function used to send the instruction to water plants to the network every 100 seconds.
+	Function used to keep the plants of every zone watered.
 	"""
+	for zone in sorted(set(gateway.zone for gateway in gateways)):
+		controls.water(zone)
+
+
+def applyRules():
+	"""
+	Function used to send the commands of the rules that are due.
+	"""
+	for zone, typeMote in controls.tick(clock()):
+		sendCommand(typeMote, zone)
+
+
+async def control():
+	"""
+	Function used to keep the plants of every zone watered, and to send the commands of the rules
+	when they are due.
+	"""
+	water()
+	await asyncio.sleep(1)
 	while True:
-		time.sleep(1)
-		sock.send(b"WATER\n")
-		time.sleep(100)
-	
+		applyRules()
+		await asyncio.sleep(RULES_TICK)
 
-def handle_client(conn):
+
+async def ingest(ingestion):
 	"""
-	Function used to receive data. In function of the data received, if it is a lightlevel, we process it.
+	Function used to process the data of the gateways. They send binary frames of records, with their logs
+	as text lines in between (see serial_protocol.py), and we process each item in the order of its gateway.
+	A shard runs on this single event loop, the decoding, the rules and the store included, so the throughput
+	of a shard is bounded by one core; the zones are spread over several shards as the gateways are added
+	(see runShards).
 	"""
 	while True:
-		data = conn.recv(1024)
-		time.sleep(0.2)
-		if not data:
-  			break
-		print(f"Received:  {data.decode()}")
-		processLightLevel(data, conn)
-				
-			
-	conn.close()
-	
-def turnOnLightbulbs(conn):
-	"""
-	Function used to command the gateway to turn on lightbulbs
-	"""
-	conn.send(b"LIGHTBULBS\n");
-
-	
-	
-def processLightLevel(data, conn):
-	"""
-	Function used to process the lightlevel received from the gateway. If it is bigger than a certain level (here, 400, can be anything else), we order the gateway to turn on lightbulbs.
-	"""
-	lightlevel = data.decode().split("LIGHTSENSOR")
-	strlightLevel = ""
-	if len(lightlevel) > 1:
-		for elem in lightlevel:
-			for char in elem:
-				if char.isdigit():
-					strlightLevel += char
-		if strlightLevel != "":
-			lightLevel = int(strlightLevel)
-			if lightLevel < 400:
-				turnOnLightbulbs(conn)
-
-
-def main(ip, port):
-	sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-	sock.connect((ip, port))
-	
-	waterThread = threading.Thread(target=water, args=(sock, ))
-	client_thread = threading.Thread(target=handle_client, args=(sock,))
-	waterThread.start()
-	client_thread.start()
+		gateway, items = await ingestion.get()
+		processItems(items, gateway)
+		ingestion.task_done()
+		# Lets the gateways send the commands of the chunk
+		await asyncio.sleep(0)
+
+
+def processItems(items, gateway):
+	"""
+	Function used to process the decoded items of a chunk of the gateway: its records and its logs.
+	"""
+	for item in items:
+		if item[0] == "record":
+			processRecord(item[1], item[2], gateway)
+		elif item[1]:
+			print(f"Log {gateway.name}:  {item[1]}")
+
+
+def processRecord(recType, value, gateway):
+	"""
+	Function used to dispatch a record received from the gateway.
+	"""
+	record = parseRecord(recType, value)
+	if record is None:
+		print(f"Unknown record {recType} of {len(value)} bytes")
+		return
+	print(f"Received:  {record}")
+	recordsReceived.inc(gateway.name, record["type"])
+	if "src" in record:
+		record["mote"] = gateway.moteName(record["src"])
+		directory.seen(gateway, record["src"], LIGHT_SENSOR if record["type"] == "LIGHT" else record.get("typeMote"))
+	if record["type"] == "LIGHT":
+		processLightLevel(record, gateway)
+	elif record["type"] == "CMD":
+		processCommandReport(record, gateway)
+	elif record["type"] == "TRACE":
+		processTrace(record)
+	elif record["type"] == "ELIDED":
+		target = COMMAND_TYPES.get(record["typeMote"], record["typeMote"])
+		commandsElided.inc(gateway.name, target)
+		print(f"Command ({target}) not sent by {gateway.name}: {record['on']} still on, none off")
+	elif record["type"] == "PATH" and "hops" in record:
+		processPath(record["kind"], record["mote"], record["hops"], record["residence"])
+	elif record["type"] == "ENERGY":
+		processEnergy(record)
+	elif record["type"] == "UPLINK":
+		processUplink(record, gateway)
+
+def processLightLevel(record, gateway):
+	"""
+	Function used to process the lightlevel received from the gateway, with the sensor and the path it took. The rules turn on
+	the lightbulbs of the zone of the gateway when the zone becomes dark (see rules.py), not for each dark reading.
+	"""
+	src = record["mote"]
+	deliveredReadings[src] = deliveredReadings.get(src, 0) + 1
+	readingsReceived.inc(gateway.name)
+	moteReadingsDelivered.inc(src)
+	if store is not None:
+		store.append(src, record["level"])
+	if "hops" in record:
+		processPath("LIGHT", src, record["hops"], record["residence"])
+	for zone, typeMote in controls.light(gateway.zone, src, record["level"], clock()):
+		sendCommand(typeMote, zone)
+
+
+# Forwarders and time spent in them by the upward messages, per source mote
+pathHops = {}
+pathResidence = {}
+pathResidenceNew = set()	# motes with residence times since the last summary
+
+def processPath(kind, src, hops, residence):
+	"""
+	Function used to process the path of an upward message (DAO, LIGHT or ACK): its forwarders and the time spent in them [ms].
+	A change in the number of forwarders of a mote is printed, since it means that its path has changed. The
+	residence times are summarized every RESIDENCE_REPORT seconds by reportResidences, not for each message.
+	"""
+	if src in pathHops and pathHops[src] != hops:
+		print(f"Path of mote {src} changed: {pathHops[src]} -> {hops} forwarders")
+	pathHops[src] = hops
+	if src not in pathResidence:
+		pathResidence[src] = LatencyStats(f"mote {src} residence")
+	pathResidence[src].add(residence)
+	pathResidenceNew.add(src)
+	moteForwarders.set(src, value=hops)
+	residenceHistogram.observe(kind, value=residence)
+
+
+def printResidences():
+	"""
+	Function used to print the residence times of the motes that sent messages since the last summary.
+	"""
+	for src in sorted(pathResidenceNew):
+		print(f"{pathResidence[src].summary()}, {pathHops[src]} forwarders")
+	pathResidenceNew.clear()
+
+
+async def reportResidences():
+	"""
+	Function used to print the residence times of the motes every RESIDENCE_REPORT seconds.
+	"""
+	while True:
+		await asyncio.sleep(RESIDENCE_REPORT)
+		printResidences()
+
+
+# Energy model of a Z1 mote: supply voltage [V] and current drawn in each state [mA]
+VOLTAGE = 3.0
+CURRENT = {"CPU": 4.0, "LPM": 0.02, "LISTEN": 18.8, "TRANSMIT": 17.4}
+
+# Energy spent [mJ], readings sent by each mote, and readings delivered to the server, per source mote
+moteEnergy = {}
+sentReadings = {}
+deliveredReadings = {}
+
+def processEnergy(record):
+	"""
+	Function used to process the energy report of a mote: time in each state and radio time per message class [ms].
+	The energy of the period is computed with the energy model, and added to the total of the mote
+	to give its energy per delivered reading.
+	"""
+	src, states, tx, rx, readings = record["mote"], record["states"], record["tx"], record["rx"], record["readings"]
+
+	energy = VOLTAGE * sum(CURRENT[state] * states[state] for state in CURRENT) / 1000
+	moteEnergy[src] = moteEnergy.get(src, 0) + energy
+	sentReadings[src] = sentReadings.get(src, 0) + readings
+	moteEnergyTotal.inc(src, amount=energy)
+	moteReadingsSent.inc(src, amount=readings)
+	for name, t, r in zip(ENERGY_CLASSES, tx, rx):
+		moteRadio.inc(src, name, "tx", amount=t)
+		moteRadio.inc(src, name, "rx", amount=r)
+	radio = ", ".join(f"{name} {t}/{r}" for name, t, r in zip(ENERGY_CLASSES, tx, rx) if t or r)
+	period = record["period"]
+	if period > 0:
+		# Average current and share of the time with the radio on, the idle drain of the low-power motes
+		current = energy / (VOLTAGE * period)
+		dutyCycle = 100 * (states["LISTEN"] + states["TRANSMIT"]) / (1000 * period)
+		moteDutyCycle.set(src, value=dutyCycle / 100)
+		print(f"Mote {src}: {energy:.1f} mJ over {period} s, {current:.3f} mA average, radio on {dutyCycle:.2f}%")
+	print(f"Mote {src}: radio tx/rx [ms]: {radio or 'none'}")
+	if "drops" in record:
+		moteDrops.set(src, value=record["drops"])
+		moteRoutes.set(src, value=record["routes"])
+		print(f"Mote {src}: {record['drops']} frames dropped by its queues, {record['routes']} routes")
+	if sentReadings[src] > 0:
+		delivered = deliveredReadings.get(src, 0)
+		if delivered:
+			print(f"Mote {src}: {moteEnergy[src] / delivered:.1f} mJ per delivered reading ({delivered}/{sentReadings[src]} delivered)")
+		else:
+			print(f"Mote {src}: no reading delivered out of {sentReadings[src]}")
+
+
+def processUplink(record, gateway):
+	"""
+	Function used to process the report of the uplink of the gateway: its use of the serial line,
+	and the records it had to drop because we did not read them fast enough.
+	"""
+	gateway.droppedRecords += record["dropped"]
+	gateway.droppedCommands += record["inputDropped"]
+	uplinkBytes.inc(gateway.name, amount=record["bytes"])
+	uplinkDropped.inc(gateway.name, amount=record["dropped"])
+	uplinkInputDropped.inc(gateway.name, amount=record["inputDropped"])
+	uplinkUtilization.set(gateway.name, value=record["utilization"] / 1000)
+	perFrame = record["records"] / record["frames"] if record["frames"] else 0
+	print(f"Uplink {gateway.name}: {record['utilization'] / 10:.1f}% of the serial line over {record['period']} s, "
+		f"{record['records']} records in {record['frames']} frames ({perFrame:.1f} per frame), "
+		f"peak {record['peak']} bytes buffered, {record['dropped']} dropped ({gateway.droppedRecords} in total), "
+		f"{record['inputDropped']} command frames lost ({gateway.droppedCommands} in total)")
+
+
+COMMAND_TYPES = {3: "sprinklers", 4: "lightbulbs"}
+
+
+class LatencyStats:
+	"""
+	Keeps the last latencies of a kind [ms], and summarizes them with percentiles and a histogram.
+	"""
+	def __init__(self, name, maxSamples=1000):
+		self.name = name
+		self.samples = collections.deque(maxlen=maxSamples)
+
+	def add(self, latency):
+		self.samples.append(latency)
+
+	def percentile(self, p, ordered=None):
+		ordered = ordered or sorted(self.samples)
+		return ordered[min(len(ordered) - 1, int(p / 100 * len(ordered)))]
+
+	def histogram(self):
+		"""
+		Returns the number of samples per bucket, the buckets being powers of two [ms].
+		"""
+		buckets = collections.Counter(1 << (math.ceil(latency) - 1).bit_length() if latency > 1 else 1 for latency in self.samples)
+		return sorted(buckets.items())
+
+	def summary(self):
+		if not self.samples:
+			return f"{self.name}: no samples"
+		ordered = sorted(self.samples)
+		buckets = " ".join(f"<={bucket}:{count}" for bucket, count in self.histogram())
+		return f"{self.name}: n={len(ordered)} p50={self.percentile(50, ordered)} ms p99={self.percentile(99, ordered)} ms [{buckets}]"
+
+
+# Time until the last ACK of each command, round trip time of each traced actuator, and delays per hop
+commandLatency = LatencyStats("command latency")
+actuatorRtt = LatencyStats("actuator round trip")
+hopDelays = {}
+
+def processCommandReport(record, gateway):
+	"""
+	Function used to process the report of a command sent by the gateway: actuators that acknowledged it
+	out of those expected, time until the last ACK [ms], and missing actuators. The rules send it again
+	soon if some actuators are missing.
+	Late ACKs of commands already reported are only printed.
+	"""
+	target = COMMAND_TYPES.get(record["typeMote"], record["typeMote"])
+	missing = " ".join(str(addr) for addr in record["missing"])
+	commandReports.inc(gateway.name, target)
+	commandAcks.inc(gateway.name, target, amount=record["acked"])
+	commandExpectedAcks.inc(gateway.name, target, amount=record["expected"])
+	print(f"Command {record['id']} ({target}): {record['acked']}/{record['expected']} acknowledged, last ACK after {record['latency']} ms", end="")
+	print(f", missing: {missing}" if missing else "")
+	if record["acked"] > 0:
+		commandLatency.add(record["latency"])
+		commandLatencyHistogram.observe(gateway.name, target, value=record["latency"])
+	printLatencies()
+	controls.acknowledged(gateway.zone, record["typeMote"], record["acked"], record["expected"], clock())
+
+
+def processTrace(record):
+	"""
+	Function used to process the trace of a command returned by an actuator: round trip time [ms],
+	and (node, delay [ms]) records from the first mote after the gateway to the actuator.
+	"""
+	actuatorRtt.add(record["rtt"])
+	actuatorRttHistogram.observe(value=record["rtt"])
+	for hop, (node, delay) in enumerate(record["records"], start=1):
+		if hop not in hopDelays:
+			hopDelays[hop] = LatencyStats(f"hop {hop}")
+		hopDelays[hop].add(delay)
+		hopDelayHistogram.observe(hop, value=delay)
+
+
+def printLatencies():
+	"""
+	Function used to print the latency histograms and the per-hop breakdown of the commands.
+	"""
+	print(commandLatency.summary())
+	print(actuatorRtt.summary())
+	for hop in sorted(hopDelays):
+		print(f"  {hopDelays[hop].summary()}")
+
+
+async def main(addresses, storePath, metricsPort):
+	"""
+	Function used to serve the gateways until they all close their connection, and the metrics meanwhile.
+	"""
+	global store
+	store = Store(storePath) if storePath else None
+	ingestion = asyncio.Queue(INGESTION_QUEUE)
+	gateways.extend(Gateway(ip, port, zone) for ip, port, zone in addresses)
+	ingester = asyncio.create_task(ingest(ingestion))
+	controller = asyncio.create_task(control())
+	reporter = asyncio.create_task(reportResidences())
+	exporter = None
+	if metricsPort:
+		metrics.collector(lambda: collectMetrics(ingestion))
+		exporter = asyncio.create_task(serveMetrics(metrics, HOSTIP, metricsPort))
+	await asyncio.gather(*(gateway.run(ingestion) for gateway in gateways))
+	await ingestion.join()
+	controller.cancel()
+	reporter.cancel()
+	ingester.cancel()
+	if exporter is not None:
+		exporter.cancel()
+	if store is not None:
+		store.close()
+
+
+def shardZones(addresses, count):
+	"""
+	Returns the addresses of the gateways of each shard. All the gateways of a zone go to the same shard, since
+	the rules of a zone need all its readings, and the zones with the most gateways are dealt first, each to the
+	shard with the fewest gateways so far.
+	"""
+	zones = {}
+	for ip, port, zone in addresses:
+		zones.setdefault(zone or f"{ip}:{port}", []).append((ip, port, zone))
+	shardAddresses = [[] for _ in range(min(count, len(zones)))]
+	for zone in sorted(zones, key=lambda zone: (-len(zones[zone]), zone)):
+		min(shardAddresses, key=len).extend(zones[zone])
+	return shardAddresses
+
+
+def runShard(index, count, addresses, storePath, metricsPort):
+	"""
+	Function used to serve the gateways of a shard, in its own process. Each shard has its own store file and
+	metrics endpoint: the port of the first shard is metricsPort, the next ones follow.
+	"""
+	global shards
+	shards = count
+	zones = sorted(set(zone or f"{ip}:{port}" for ip, port, zone in addresses))
+	print(f"Shard {index}: {len(addresses)} gateways, zones {' '.join(zones)}")
+	asyncio.run(main(addresses, f"{storePath}.{index}" if storePath else "", metricsPort + index if metricsPort else 0))
+
+
+def runShards(addresses, count, storePath, metricsPort):
+	"""
+	Function used to serve the gateways in count shards (as many as the cores if 0), each in its own process,
+	until they all close their connection. A single shard is served in this process.
+	"""
+	shardAddresses = shardZones(addresses, count or os.cpu_count() or 1)
+	if len(shardAddresses) == 1:
+		asyncio.run(main(addresses, storePath, metricsPort))
+		return
+	processes = [multiprocessing.Process(target=runShard, args=(i, len(shardAddresses), shard, storePath, metricsPort))
+		for i, shard in enumerate(shardAddresses)]
+	for process in processes:
+		process.start()
+	for process in processes:
+		process.join()
+
+
+def parseAddress(address):
+	"""
+	Returns the (ip, port, zone) of an "ip:port[@zone]" argument.
+	"""
+	address, _, zone = address.partition("@")
+	ip, _, port = address.rpartition(":")
+	return ip or HOSTIP, int(port), zone or None
 
 
 if __name__ == "__main__":
 
     parser = argparse.ArgumentParser()
-    parser.add_argument("--ip", dest="ip", type=str)
-    parser.add_argument("--port", dest="port", type=int)
+    parser.add_argument("--ip", dest="ip", type=str, default=HOSTIP)
+    parser.add_argument("--port", dest="port", type=int, default=HOSTPORT)
+    parser.add_argument("--gateway", dest="gateways", type=parseAddress, action="append",
+        help="ip:port[@zone] of a gateway, can be repeated (instead of --ip and --port). "
+        "The gateways of a zone share their light level, each gateway is its own zone by default")
+    parser.add_argument("--store", dest="store", type=str, default="",
+        help="file of the history of the readings (see tsdb.py), none by default")
+    parser.add_argument("--metrics", dest="metrics", type=int, default=METRICS_PORT,
+        help="port of the metrics endpoint (http://localhost:port/metrics, see metrics.py), 0 for none")
+    parser.add_argument("--shards", dest="shards", type=int, default=0,
+        help="processes serving the gateways, each for its own zones, as many as the cores by default. "
+        "Each shard has its own metrics port (--metrics, then the next ones) and store file (--store.index)")
     args = parser.parse_args()
 
-    main(args.ip, args.port)
-
+    runShards(args.gateways or [(args.ip, args.port, None)], args.shards, args.store, args.metrics)
@@ -0,0 +1,183 @@
+"""
+Time-series store of the server: the history of the readings of each sensor, in a memory-mapped file.
+
+Each series (one per sensor) has a fixed-size ring buffer per tier: the raw readings, and their
+aggregates per minute and per hour (count, mean, min, max). The file is sized once, for MAX_SERIES
+series, so the memory used does not grow with the deployment, and an append only writes the slot of
+each tier in place. The readings of a series must come in time order: the store is reopened as it
+was left after a restart of the server.
+"""
+
+import bisect
+import mmap
+import os
+import struct
+import time
+
+MAGIC = b"MOTETSDB"
+VERSION = 1
+
+# Number of series of a new file
+MAX_SERIES = 256
+
+# Tiers: name, length of the buckets [sec] (0 for the raw readings), and number of slots
+TIERS = [("raw", 0, 1440), ("1m", 60, 1440), ("1h", 3600, 720)]
+
+# File header: magic, version, number of series, slots of each tier
+HEADER = struct.Struct("<8sI I" + "I" * len(TIERS))
+# Header of a series: name, time of its last reading, then head and count of each tier
+SERIES = struct.Struct("<32sd" + "II" * len(TIERS))
+# Slot of the raw tier: time, value
+RAW = struct.Struct("<df")
+# Slot of an aggregated tier: start of the bucket, count, sum, min, max
+AGGREGATE = struct.Struct("<dIdff")
+
+NAME_SIZE = 32
+
+
+class Store:
+	"""
+	Time-series store in the file at path, created for maxSeries series if it doesn't exist.
+	"""
+	def __init__(self, path, maxSeries=MAX_SERIES):
+		self.slots = [slots for _, _, slots in TIERS]
+		self.slotSizes = [RAW.size if bucket == 0 else AGGREGATE.size for _, bucket, _ in TIERS]
+		exists = os.path.exists(path) and os.path.getsize(path) > 0
+		self.file = open(path, "r+b" if exists else "w+b")
+		if exists:
+			magic, version, self.maxSeries, *slots = HEADER.unpack(self.file.read(HEADER.size))
+			if magic != MAGIC or version != VERSION or slots != self.slots:
+				raise ValueError(f"{path} is not a time-series store of this version")
+		else:
+			self.maxSeries = maxSeries
+			self.file.truncate(self.seriesOffset(maxSeries))
+			self.file.write(HEADER.pack(MAGIC, VERSION, maxSeries, *self.slots))
+			self.file.flush()
+		self.map = mmap.mmap(self.file.fileno(), self.seriesOffset(self.maxSeries))
+		self.index = {}
+		for i in range(self.maxSeries):
+			name = self.map[self.seriesOffset(i):self.seriesOffset(i) + NAME_SIZE].rstrip(b"\0")
+			if not name:
+				break
+			self.index[name] = i
+		self.dropped = 0	# readings of the series that did not fit
+
+	def seriesSize(self):
+		"""
+		Returns the size of a series in the file, its header and its slots [bytes].
+		"""
+		return SERIES.size + sum(slots * size for slots, size in zip(self.slots, self.slotSizes))
+
+	def seriesOffset(self, series):
+		return HEADER.size + series * self.seriesSize()
+
+	def slotOffset(self, series, tier, slot):
+		"""
+		Returns the offset of a slot of a tier of a series in the file.
+		"""
+		offset = self.seriesOffset(series) + SERIES.size
+		offset += sum(slots * size for slots, size in zip(self.slots[:tier], self.slotSizes[:tier]))
+		return offset + slot * self.slotSizes[tier]
+
+	def lookup(self, name, create=False):
+		"""
+		Returns the index of the series of the given name, creating it if asked and there is room, or None.
+		The series are indexed by their name as it is in the file, cut to NAME_SIZE bytes, so that they
+		are found again after a restart: the names sharing their first NAME_SIZE bytes share their series.
+		"""
+		key = name.encode()[:NAME_SIZE]
+		series = self.index.get(key)
+		if series is None and create and len(self.index) < self.maxSeries:
+			series = len(self.index)
+			SERIES.pack_into(self.map, self.seriesOffset(series), key, 0, *([0] * 2 * len(TIERS)))
+			self.index[key] = series
+		return series
+
+	def append(self, name, value, now=None):
+		"""
+		Appends a reading to the series of the given name, and to the buckets of its aggregated tiers.
+		A reading older than the last one of the series is stored at the time of the last one.
+		"""
+		series = self.lookup(name, create=True)
+		if series is None:
+			self.dropped += 1
+			return
+		now = time.time() if now is None else now
+		header = list(SERIES.unpack_from(self.map, self.seriesOffset(series)))
+		now = max(now, header[1])
+		header[1] = now
+		for tier, (_, bucket, slots) in enumerate(TIERS):
+			head, count = header[2 + 2 * tier], header[3 + 2 * tier]
+			if bucket == 0:
+				RAW.pack_into(self.map, self.slotOffset(series, tier, head), now, value)
+				head, count = (head + 1) % slots, min(count + 1, slots)
+			else:
+				start = now - now % bucket
+				last = self.slotOffset(series, tier, (head - 1) % slots)
+				lastStart, n, total, low, high = AGGREGATE.unpack_from(self.map, last)
+				if count > 0 and lastStart == start:
+					AGGREGATE.pack_into(self.map, last, start, n + 1, total + value, min(low, value), max(high, value))
+				else:
+					AGGREGATE.pack_into(self.map, self.slotOffset(series, tier, head), start, 1, value, value, value)
+					head, count = (head + 1) % slots, min(count + 1, slots)
+			header[2 + 2 * tier], header[3 + 2 * tier] = head, count
+		SERIES.pack_into(self.map, self.seriesOffset(series), *header)
+
+	def range(self, name, start, end, tier="raw"):
+		"""
+		Returns the points of the series of the given name in [start, end[, oldest first, from the given tier:
+		(time, value) for the raw readings, (start, count, mean, min, max) for the aggregates.
+		"""
+		series = self.lookup(name)
+		if series is None:
+			return []
+		tierIndex = [tierName for tierName, _, _ in TIERS].index(tier)
+		slots = self.slots[tierIndex]
+		header = SERIES.unpack_from(self.map, self.seriesOffset(series))
+		head, count = header[2 + 2 * tierIndex], header[3 + 2 * tierIndex]
+		first = (head - count) % slots
+		raw = TIERS[tierIndex][1] == 0
+		unpack = RAW.unpack_from if raw else AGGREGATE.unpack_from
+
+		def point(i):
+			return unpack(self.map, self.slotOffset(series, tierIndex, (first + i) % slots))
+
+		# The slots are in time order from the oldest: binary search of the window
+		times = _Times(point, count)
+		points = [point(i) for i in range(bisect.bisect_left(times, start), bisect.bisect_left(times, end))]
+		if raw:
+			return points
+		return [(bucket, n, total / n, low, high) for bucket, n, total, low, high in points]
+
+	def window(self, name, seconds, tier="raw", now=None):
+		"""
+		Returns the points of the series of the given name over the last seconds.
+		"""
+		now = time.time() if now is None else now
+		return self.range(name, now - seconds, float("inf"), tier)
+
+	def names(self):
+		return [key.decode(errors="replace") for key in self.index]
+
+	def flush(self):
+		self.map.flush()
+
+	def close(self):
+		self.map.flush()
+		self.map.close()
+		self.file.close()
+
+
+class _Times:
+	"""
+	Sequence of the times of the points of a tier, for bisect.
+	"""
+	def __init__(self, point, count):
+		self.point = point
+		self.count = count
+
+	def __len__(self):
+		return self.count
+
+	def __getitem__(self, i):
+		return self.point(i)[0]